@@ -35,6 +35,7 @@
 #endif
 
 #include <map>
+#include <unordered_map>
 #include <tuple>
 #include <array>
 #include <utility>
@@ -45,9 +46,15 @@
 #include <locale>
 #include <memory>
 #include <functional>
+#include <mutex>
 #include <type_traits>
 #include <algorithm>
 #include <sstream>
+#include <ostream>
+#include <limits>
+#include <iterator>
+#include <typeinfo>
+#include <typeindex>
 
 /**
   clang supports the pre-c++17 attribute gnu::fallthrough
@@ -471,6 +478,17 @@ typedef std::multimap<std::basic_string<char32_t>,any> variable_map32;
     always implies a hidden (deprecated)`--bar_old`, then `raw_key` is
     `b` and include `--bar_old` in the packed arguments;
 
+  - `packed_flags`
+
+    A string containing any remaining packed single character flags if
+    present. Each character `c` is parsed as if the argument `-c` was
+    given immediately following the current one. This is the compact
+    form of `packed_arguments` for the common case of grouped POSIX
+    flags. For example, `-abcd` has a raw key of `a` and packed flags
+    of `bcd` which is equivalent to the packed arguments
+    `{"-b","-c","-d"}` without having to construct each argument.
+    If both are present, the packed flags are parsed first;
+
   - `value`
 
     A string containing the value if present. For example, if the
@@ -526,7 +544,8 @@ typedef std::multimap<std::basic_string<char32_t>,any> variable_map32;
   7) -fbar        = 4 short options with keys: 'f', 'b', 'a', and 'r'
                   : prefix = "-"
                   : raw_key = "f"
-                  : packed_arguments = {"-b","-a","-r"}
+                  : packed_arguments = ""
+                  : packed_flags = "bar"
                   : value = ""
                   : value_provided = false
 
@@ -561,13 +580,16 @@ struct basic_option_pack {
   string_type raw_key;
   packed_arg_seq packed_arguments;
   string_type value;
+  string_type packed_flags;
 
   basic_option_pack(bool _did_unpack, bool _value_provided = false,
     const string_type &_raw_key = string_type(),
     const packed_arg_seq & _packed_arguments = packed_arg_seq(),
-    const string_type &_value = string_type()) :did_unpack(_did_unpack),
-      value_provided(_value_provided), raw_key(_raw_key),
-      packed_arguments(_packed_arguments), value(_value) {}
+    const string_type &_value = string_type(),
+    const string_type &_packed_flags = string_type())
+      :did_unpack(_did_unpack), value_provided(_value_provided),
+        raw_key(_raw_key), packed_arguments(_packed_arguments), value(_value),
+        packed_flags(_packed_flags) {}
 };
 
 enum parse_flag {
@@ -591,6 +613,20 @@ typedef basic_option_pack<char32_t> option_pack32;
   appropriately set fields determines how the argument string is parsed.
   A default constructed `option_description` or one with no fields set
   is ignored by `parse_arguments` completely.
+
+  Thread safety: `parse_arguments` and friends never modify the group
+  or its descriptions and keep all parsing state local to the call. The
+  same group can therefore be used to parse from several threads at once
+  (see `parse_batch` in cmd_options/parallel.h) provided that every
+  callback set here can be called concurrently. That is, a callback may
+  read what it captured but any state it writes that outlives the call
+  (for example, a counter or an external variable) must be synchronized
+  by the callback itself. Callbacks are only given the variable map for
+  the parse in progress so they never see another thread's results.
+  Descriptions made by the EZ interface satisfy this. The exception is a
+  `basic_value` given a user callback, which is called as each value is
+  parsed and so must itself be safe to call concurrently. None of the
+  unpack functions or EZ builders keep function-local static state.
 */
 template<typename CharT>
 struct basic_option_description {
@@ -899,6 +935,30 @@ struct basic_option_description {
   */
   std::function<void(const variable_map_type &vm)> finalize;
 
+  /*
+    If set and the description represents an operand, the operands it
+    accepts are not converted as they are parsed. Instead, consecutive
+    operands are recorded by their location in the argument range in a
+    single `basic_operand_range` stored in the `variable_map` under
+    `mapped_key`. The range calls `make_lazy_value` to convert each
+    operand only when it is visited. This allows very large operand lists
+    to be processed without holding a converted copy of each one. If set,
+    `make_value` is not used for operands accepted by this description.
+
+    The arguments have the same meaning as the arguments to `make_value`.
+    The `variable_map` is not provided as conversion takes place after
+    parsing is complete.
+
+    Operands that do not come directly from the argument range, for
+    example those returned in `packed_arguments`, are copied into a range
+    of their own.
+
+    N.B. the range refers to the argument range given to `parse_arguments`
+    which must outlive the returned `variable_map`. Conversion errors are
+    not reported until the operand is visited.
+  */
+  std::function<any(const string_type &mapped_key, std::size_t posn,
+    std::size_t argn, const string_type &value)> make_lazy_value;
 };
 
 typedef basic_option_description<char> option_description;
@@ -915,6 +975,145 @@ typedef std::vector<basic_option_description<char16_t> > options_group16;
 typedef std::vector<basic_option_description<char32_t> > options_group32;
 
 
+/*
+  A sequence of consecutive operands stored in the `variable_map` by
+  their location in the argument range rather than by value. See
+  `basic_option_description::make_lazy_value`.
+
+  Each operand is read from the argument range and converted when
+  visited so iterating over the range holds at most one converted value
+  at a time. Use `for_each_value` to visit every value stored under a key
+  regardless of whether it is held in a range or not.
+*/
+template<typename CharT>
+class basic_operand_range {
+  public:
+    typedef std::basic_string<CharT> string_type;
+
+    typedef std::function<string_type(std::size_t index)> argument_fn;
+    typedef std::function<any(const string_type &mapped_key, std::size_t posn,
+      std::size_t argn, const string_type &value)> convert_fn;
+
+    /*
+      Start a range of one operand at \c index of the argument range
+      where it was the \c posn operand and \c argn argument parsed. The
+      functions are shared by every range made by the same parse.
+    */
+    basic_operand_range(const string_type &mapped_key,
+      const std::shared_ptr<const argument_fn> &argument,
+      const std::shared_ptr<const convert_fn> &convert,
+      std::size_t index, std::size_t posn, std::size_t argn)
+        :_mapped_key(mapped_key), _argument(argument), _convert(convert),
+          _index(index), _posn(posn), _argn(argn), _size(1) {}
+
+    std::size_t size(void) const {
+      return _size;
+    }
+
+    /*
+      The unconverted nth operand in the range
+    */
+    string_type argument(std::size_t n) const {
+      return (*_argument)(_index+n);
+    }
+
+    /*
+      The converted nth operand in the range
+    */
+    any value(std::size_t n) const {
+      return (*_convert)(_mapped_key,_posn+n,_argn+n,argument(n));
+    }
+
+    /*
+      True if the operand at \c index of the argument range and parsed as
+      the \c posn operand and \c argn argument directly follows this
+      range.
+    */
+    bool is_next(std::size_t index, std::size_t posn, std::size_t argn) const
+    {
+      return index == _index+_size && posn == _posn+_size &&
+        argn == _argn+_size;
+    }
+
+    void extend(void) {
+      ++_size;
+    }
+
+  private:
+    string_type _mapped_key;
+    std::shared_ptr<const argument_fn> _argument;
+    std::shared_ptr<const convert_fn> _convert;
+    std::size_t _index;
+    std::size_t _posn;
+    std::size_t _argn;
+    std::size_t _size;
+};
+
+typedef basic_operand_range<char> operand_range;
+typedef basic_operand_range<wchar_t> woperand_range;
+typedef basic_operand_range<char16_t> operand_range16;
+typedef basic_operand_range<char32_t> operand_range32;
+
+namespace detail {
+
+template<typename CharT>
+inline const basic_operand_range<CharT> *
+as_operand_range(const any &val)
+{
+  if(val.type() != typeid(basic_operand_range<CharT>))
+    return 0;
+
+  return &any_cast<const basic_operand_range<CharT> &>(val);
+}
+
+}
+
+/*
+  The number of values stored under \c key counting each operand in a
+  `basic_operand_range` separately.
+*/
+template<typename CharT>
+inline std::size_t
+count_values(const typename basic_variable_map<CharT>::key_type &key,
+  const basic_variable_map<CharT> &vm)
+{
+  std::size_t count = 0;
+
+  auto &&range = vm.equal_range(key);
+  for(auto cur = range.first; cur != range.second; ++cur) {
+    const basic_operand_range<CharT> *operands =
+      detail::as_operand_range<CharT>(cur->second);
+    count += (operands ? operands->size() : 1);
+  }
+
+  return count;
+}
+
+/*
+  Call \c fn in order with each value of type T stored under \c key.
+  Operands held in a `basic_operand_range` are converted one at a time as
+  they are reached.
+*/
+template<typename T, typename CharT, typename Fn>
+inline void
+for_each_value(const typename basic_variable_map<CharT>::key_type &key,
+  const basic_variable_map<CharT> &vm, Fn fn)
+{
+  auto &&range = vm.equal_range(key);
+  for(auto cur = range.first; cur != range.second; ++cur) {
+    const basic_operand_range<CharT> *operands =
+      detail::as_operand_range<CharT>(cur->second);
+
+    if(!operands)
+      fn(any_cast<T>(cur->second));
+    else {
+      for(std::size_t n = 0; n < operands->size(); ++n)
+        fn(any_cast<T>(operands->value(n)));
+    }
+  }
+}
+
+
 /*
   POSIX flag syntax. Unpack alphanumeric arguments in the form:
 
@@ -949,34 +1148,22 @@ template<bool uses_packed_flags, typename CharT>
 basic_option_pack<CharT> unpack_posix(const std::basic_string<CharT> &str)
 {
   typedef basic_option_pack<CharT> option_pack;
-  typedef typename option_pack::string_type string_type;
-  typedef typename option_pack::packed_arg_seq packed_arg_seq;
-
-  // use this form to automatically convert single byte ASCII (UTF) encoding
-  // to wider equivalent. Works because each is part of the basic source
-  // character set.
-  static const string_type sprefix{'-'};
 
-  auto res =
-    detail::mismatch(sprefix.begin(),sprefix.end(),str.begin(),str.end());
-  if(res.first != sprefix.end() || res.second == str.end())
+  // The prefix is compared as a single character rather than held in a
+  // static string so that there is no shared state between calls. Works
+  // for any encoding because '-' is part of the basic source character set.
+  if(str.size() < 2 || str[0] != CharT('-'))
     return option_pack(false);
 
-  if(res.second+1 == str.end())
-    return option_pack(true,false,{res.second,res.second+1},{},{});
+  auto key = str.begin()+1;
 
-  if(uses_packed_flags) {
-    string_type raw_key{res.second,res.second+1};
+  if(key+1 == str.end())
+    return option_pack(true,false,{key,key+1},{},{});
 
-    packed_arg_seq packed_arguments;
-    while(++res.second != str.end())
-      packed_arguments.push_back(sprefix+(*(res.second)));
+  if(uses_packed_flags)
+    return option_pack{true,false,{key,key+1},{},{},{key+1,str.end()}};
 
-    return option_pack{true,false,raw_key,packed_arguments,{}};
-  }
-
-  return option_pack{true,true,{res.second,res.second+1},{},
-    {res.second+1,str.end()}};
+  return option_pack{true,true,{key,key+1},{},{key+1,str.end()}};
 }
 
 /*
@@ -1029,28 +1216,250 @@ basic_option_pack<CharT> unpack_gnu(const std::basic_string<CharT> &str)
   typedef basic_option_pack<CharT> option_pack;
   typedef std::basic_string<CharT> string_type;
 
-  // use this form to automatically convert single byte ASCII (UTF) encoding
-  // to wider equivalent. Works because each is part of the basic source
-  // character set.
-  static const string_type lprefix{'-','-'};
-  static const string_type assignment{'='};
-
-  auto &&res =
-    detail::mismatch(lprefix.begin(),lprefix.end(),str.begin(),str.end());
-  if(res.first != lprefix.end() || res.second == str.end())
+  // As with unpack_posix, the prefix and assignment are single characters
+  // from the basic source character set so no shared state is needed.
+  if(str.size() < 3 || str[0] != CharT('-') || str[1] != CharT('-'))
     return unpack_posix<uses_packed_flags>(str);
 
+  auto key = str.begin()+2;
+
   typename string_type::const_iterator assign_loc =
-    std::search(res.second,str.end(),assignment.begin(),assignment.end());
+    std::find(key,str.end(),CharT('='));
 
   if(assign_loc == str.end())
-    return option_pack{true,false,{res.second,str.end()},{},{}};
+    return option_pack{true,false,{key,str.end()},{},{}};
+
+  return option_pack{true,true,{key,assign_loc},{},{assign_loc+1,str.end()}};
+}
+
+
+
+namespace detail {
+
+/*
+  Told of the files and environment variables read by the parse running
+  on the current thread, see basic_parse_cache. Sources that read either
+  in addition to the arguments report them through observe_file and
+  observe_environment.
+*/
+struct source_observer {
+  std::function<void(const std::string &)> file;
+  std::function<void(const std::string &,const char * const *)> environment;
+};
+
+inline source_observer *& current_source_observer(void)
+{
+  static thread_local source_observer *observer = nullptr;
+  return observer;
+}
+
+/*
+  \c filename was opened
+*/
+inline void observe_file(const std::string &filename)
+{
+  source_observer *observer = current_source_observer();
+  if(observer && observer->file)
+    observer->file(filename);
+}
+
+/*
+  The variables in \c env starting with \c prefix were read
+*/
+inline void observe_environment(const std::string &prefix,
+  const char * const *env)
+{
+  source_observer *observer = current_source_observer();
+  if(observer && observer->environment)
+    observer->environment(prefix,env);
+}
+
+/*
+  Assign the argument referenced by an iterator given to the parser to a
+  string. Arguments are typically given as `const CharT *` (ie argv) or
+  `basic_string<CharT>`.
+*/
+template<typename CharT>
+inline void assign_argument(std::basic_string<CharT> &str, const CharT *arg)
+{
+  str.assign(arg);
+}
+
+template<typename CharT>
+inline void assign_argument(std::basic_string<CharT> &str,
+  const std::basic_string<CharT> &arg)
+{
+  str.assign(arg);
+}
+
+/*
+  The function a basic_operand_range reads the argument at an index of
+  [first,last) with. Random access iterators are indexed directly. Other
+  iterators are collected once so that each argument is still reached in
+  constant time rather than by walking from first.
+*/
+template<typename CharT, typename RandomAccessIterator>
+std::shared_ptr<const typename basic_operand_range<CharT>::argument_fn>
+make_range_argument(RandomAccessIterator first, RandomAccessIterator,
+  std::random_access_iterator_tag)
+{
+  typedef typename basic_operand_range<CharT>::argument_fn argument_fn;
+
+  return std::make_shared<const argument_fn>([first](std::size_t index) {
+    std::basic_string<CharT> str;
+    assign_argument(str,first[index]);
+    return str;
+  });
+}
 
-  return option_pack{true,true,{res.second,assign_loc},{},
-    {assign_loc+1,str.end()}};
+template<typename CharT, typename BidirectionalIterator>
+std::shared_ptr<const typename basic_operand_range<CharT>::argument_fn>
+make_range_argument(BidirectionalIterator first, BidirectionalIterator last,
+  std::bidirectional_iterator_tag)
+{
+  typedef typename basic_operand_range<CharT>::argument_fn argument_fn;
+
+  auto args = std::make_shared<std::vector<BidirectionalIterator> >();
+  for(; first != last; ++first)
+    args->push_back(first);
+
+  return std::make_shared<const argument_fn>([args](std::size_t index) {
+    std::basic_string<CharT> str;
+    assign_argument(str,*(*args)[index]);
+    return str;
+  });
 }
 
+/*
+  The arguments remaining to be parsed by `parse_incremental_arguments`.
+
+  The bottom of the stack is the argument range given to the parser. It is
+  read in place one argument at a time rather than copied up front. Packed
+  arguments returned by an unpack function are pushed on top of the range
+  as a new frame and are consumed before returning to the range. Packed
+  flags are pushed as a frame holding the remaining characters and each
+  flag argument `-c` is formed on demand in a single reused buffer.
+*/
+template<typename CharT, typename BidirectionalIterator>
+class argument_stack {
+  public:
+    typedef std::basic_string<CharT> string_type;
+    typedef std::vector<string_type> frame_type;
+
+    argument_stack(BidirectionalIterator first, BidirectionalIterator last)
+      :_cur(first), _last(last), _consumed(0)
+    {
+      if(_cur != _last)
+        assign_argument(_arg,*_cur);
+    }
+
+    bool empty(void) const {
+      return _frames.empty() && _cur == _last;
+    }
+
+    /*
+      True if there are no packed frames on top of the argument range
+    */
+    bool at_range(void) const {
+      return _frames.empty();
+    }
+
+    bool frame_empty(void) const {
+      return (_frames.empty() ? _cur == _last : _frames.back().empty());
+    }
+
+    void pop_frame(void) {
+      _frames.pop_back();
+    }
+
+    void push_frame(frame_type &&frame) {
+      std::reverse(frame.begin(),frame.end());
+      _frames.emplace_back(std::move(frame));
+    }
+
+    void push_flags(string_type &&flags) {
+      _frames.emplace_back(std::move(flags));
+    }
+
+    string_type & front(void) {
+      if(_frames.empty())
+        return _arg;
+
+      packed_frame &frame = _frames.back();
+      if(frame.flags_remaining()) {
+        // use this form to automatically convert single byte ASCII (UTF)
+        // encoding to wider equivalent.
+        _flag_arg.assign(1,CharT('-'));
+        _flag_arg.push_back(frame.flags[frame.next_flag]);
+        return _flag_arg;
+      }
+
+      return frame.arguments.back();
+    }
+
+    void pop_front(void) {
+      if(!_frames.empty()) {
+        packed_frame &frame = _frames.back();
+        if(frame.flags_remaining())
+          ++frame.next_flag;
+        else
+          frame.arguments.pop_back();
+      }
+      else {
+        ++_consumed;
+        if(++_cur != _last)
+          assign_argument(_arg,*_cur);
+      }
+    }
+
+    /*
+      The number of arguments consumed from the argument range
+    */
+    std::size_t consumed(void) const {
+      return _consumed;
+    }
+
+    /*
+      The location in the argument range of the last argument consumed
+    */
+    BidirectionalIterator position(void) const {
+      return std::prev(_cur);
+    }
+
+  private:
+    /*
+      Either a reversed sequence of packed arguments or the packed flag
+      characters along with the index of the next flag.
+    */
+    struct packed_frame {
+      packed_frame(frame_type &&_arguments)
+        :arguments(std::move(_arguments)), next_flag(0) {}
+
+      packed_frame(string_type &&_flags)
+        :flags(std::move(_flags)), next_flag(0) {}
+
+      bool flags_remaining(void) const {
+        return next_flag < flags.size();
+      }
+
+      bool empty(void) const {
+        return !flags_remaining() && arguments.empty();
+      }
+
+      frame_type arguments;
+      string_type flags;
+      std::size_t next_flag;
+    };
+
+    BidirectionalIterator _cur;
+    BidirectionalIterator _last;
+    std::size_t _consumed;
+    string_type _arg;
+    string_type _flag_arg;
+    std::vector<packed_frame> _frames;
+};
 
+}
 
 /*
   Parse the arguments contained in \c argv with size \c argc according
@@ -1078,6 +1487,10 @@ basic_option_pack<CharT> unpack_gnu(const std::basic_string<CharT> &str)
   We are going with (3) for efficiency reasons. Ie if _any_ option_description
   can successfully unpack "-b" then "-b" is considered an option and not an
   option_argument even if it is an invalid option
+
+  Once \c end_of_options is seen, the remainder of the arguments are
+  operands. These are processed in a single pass directly from the
+  argument range rather than one at a time through the option machinery.
 */
 template<typename BidirectionalIterator, typename CharT =
   typename std::remove_pointer<
@@ -1090,38 +1503,142 @@ parse_incremental_arguments(BidirectionalIterator first,
 {
   typedef std::basic_string<CharT> string_type;
   typedef basic_option_pack<CharT> option_pack_type;
-  typedef basic_options_group<CharT> options_group_type;
+  typedef basic_option_description<CharT> description_type;
   typedef basic_variable_map<CharT> variable_map_type;
 
-  typedef std::vector<string_type> args_list;
-  typedef std::vector<args_list> cmd_stack_type;
+  typedef std::vector<const description_type *> description_list;
+  typedef basic_operand_range<CharT> operand_range_type;
+  typedef typename operand_range_type::argument_fn argument_fn;
+  typedef typename operand_range_type::convert_fn convert_fn;
+  typedef std::shared_ptr<const argument_fn> argument_ptr;
+  typedef std::shared_ptr<const convert_fn> convert_ptr;
+  typedef typename variable_map_type::iterator vm_iterator;
 
   variable_map_type _vm = vm;
 
-  cmd_stack_type cmd_stack{
-    args_list{
-      std::reverse_iterator<BidirectionalIterator>(last),
-      std::reverse_iterator<BidirectionalIterator>(first)
-    }
-  };
+  detail::argument_stack<CharT,BidirectionalIterator> args(first,last);
+
+  // Split the group once rather than checking every description for
+  // every argument. Descriptions with neither field set are ignored.
+  description_list option_descs;
+  description_list operand_descs;
+  for(auto &_desc : grp) {
+    if(_desc.unpack_option)
+      option_descs.push_back(&_desc);
+    else if(_desc.mapped_key)
+      operand_descs.push_back(&_desc);
+  }
 
   std::size_t arg_count = 0;
   std::size_t operand_count = 0;
   std::size_t option_count = 0;
-  std::size_t nargs = cmd_stack[0].size();
 
+  const string_type no_raw_key;
   string_type arg;
   parse_flag handles_arg = parse_flag::reject;
   string_type mapped_key;
   option_pack_type option_pack(false);
 
-  typename options_group_type::const_iterator desc;
+  const description_type *desc = 0;
+
+  // Lazy operands taken directly from the argument range are read back
+  // through this, made when the first is found. See
+  // basic_option_description::make_lazy_value
+  argument_ptr range_argument;
+
+  // the make_lazy_value of each description shared by its ranges
+  std::map<const description_type *,convert_ptr> lazy_convert;
+
+  // the range, if any, that the next lazy operand may extend
+  vm_iterator lazy_tail = _vm.end();
+
+  // Record the lazy operand in `arg` accepted by `desc` under `mapped_key`.
+  // Consecutive operands from the argument range share a single range.
+  auto add_lazy_operand = [&](const description_type *lazy_desc) {
+    convert_ptr &convert = lazy_convert[lazy_desc];
+    if(!convert)
+      convert = std::make_shared<const convert_fn>(lazy_desc->make_lazy_value);
+
+    if(args.at_range()) {
+      std::size_t index = args.consumed()-1;
+
+      if(lazy_tail != _vm.end() && lazy_tail->first == mapped_key) {
+        operand_range_type &range =
+          any_cast<operand_range_type &>(lazy_tail->second);
+
+        if(range.is_next(index,operand_count,arg_count)) {
+          range.extend();
+          return;
+        }
+      }
+
+      if(!range_argument) {
+        range_argument = detail::make_range_argument<CharT>(first,last,
+          typename std::iterator_traits<
+            BidirectionalIterator>::iterator_category());
+      }
+
+      lazy_tail = _vm.emplace(mapped_key,operand_range_type(mapped_key,
+        range_argument,convert,index,operand_count,arg_count));
+    }
+    else {
+      string_type value = arg;
+      _vm.emplace(mapped_key,operand_range_type(mapped_key,
+        std::make_shared<const argument_fn>(
+          [value](std::size_t) { return value; }),convert,0,
+        operand_count,arg_count));
+
+      lazy_tail = _vm.end();
+    }
+  };
+
+  // Find the desc to handle the operand in `arg` and add its value. If
+  // `hint` is the last value added under the same key, the new value is
+  // placed directly after it. Returns the added value or end() if ignored
+  auto add_operand = [&](vm_iterator hint) -> vm_iterator {
+    typename description_list::const_iterator cur = operand_descs.begin();
+    for(; cur != operand_descs.end(); ++cur) {
+      handles_arg = parse_flag::reject;
+      std::tie(handles_arg,mapped_key) =
+        (*cur)->mapped_key(no_raw_key,operand_count,arg_count,_vm);
+
+      if(handles_arg != parse_flag::reject)
+        break;
+    }
+
+    if(cur == operand_descs.end())
+      throw unexpected_operand_error(operand_count,arg_count);
+
+    if((*cur)->make_lazy_value) {
+      if(!(handles_arg & parse_flag::ignore))
+        add_lazy_operand(*cur);
+
+      ++operand_count;
+      ++arg_count;
+
+      return _vm.end();
+    }
+
+    any val;
+    if((*cur)->make_value)
+      val = (*cur)->make_value(mapped_key,operand_count,arg_count,arg,_vm);
+
+    ++operand_count;
+    ++arg_count;
+
+    if(handles_arg & parse_flag::ignore)
+      return _vm.end();
+
+    if(hint != _vm.end() && hint->first == mapped_key)
+      return _vm.emplace_hint(std::next(hint),mapped_key,std::move(val));
+
+    return _vm.emplace(mapped_key,std::move(val));
+  };
 
   int state = 0;
-  while(!cmd_stack.empty()) {
-    args_list &current_cmdlist = cmd_stack.back();
-    if(current_cmdlist.empty()) {
-      cmd_stack.pop_back();
+  while(!args.empty()) {
+    if(args.frame_empty()) {
+      args.pop_frame();
       continue;
     }
 
@@ -1129,19 +1646,19 @@ parse_incremental_arguments(BidirectionalIterator first,
       case 0: {
         // pull arg off cmdlist and determine if it is an option or an
         // operand
-        if(cmd_stack.size() == 1 && current_cmdlist.back() == end_of_options) {
-          current_cmdlist.pop_back();
+        if(args.at_range() && args.front() == end_of_options) {
+          args.pop_front();
           state = 4;
           break;
         }
 
         state = 3; // assume an operand
 
-        for(desc = grp.begin(); desc != grp.end(); ++desc) {
-          if(!desc->unpack_option)
-            continue;
+        for(auto cur = option_descs.begin(); cur != option_descs.end(); ++cur)
+        {
+          desc = *cur;
 
-          option_pack = std::move(desc->unpack_option(current_cmdlist.back()));
+          option_pack = std::move(desc->unpack_option(args.front()));
 
           if(!option_pack.did_unpack)
             continue;
@@ -1167,8 +1684,8 @@ parse_incremental_arguments(BidirectionalIterator first,
 
       case 1: {
         // option is found pull off and handle it
-        arg = std::move(current_cmdlist.back());
-        current_cmdlist.pop_back();
+        arg = std::move(args.front());
+        args.pop_front();
 
         if(!desc->make_value) {
           // strictly no values
@@ -1200,7 +1717,7 @@ parse_incremental_arguments(BidirectionalIterator first,
             if(!(handles_arg & parse_flag::ignore))
               _vm.emplace(mapped_key,val);
           }
-          else if(current_cmdlist.empty()) {
+          else if(args.frame_empty()) {
             // no more items in the current pack
             throw missing_argument_error(option_count,arg_count);
           }
@@ -1208,47 +1725,44 @@ parse_incremental_arguments(BidirectionalIterator first,
             // try to use the next argument on the command list. If any
             // desc can unpack it, then it is a (possibly ill-formed)
             // option and not an argument
-            typename options_group_type::const_iterator next;
-            for(next = grp.begin(); next != grp.end(); ++next) {
-              if(!next->unpack_option)
-                continue;
-
+            typename description_list::const_iterator next;
+            for(next = option_descs.begin(); next != option_descs.end();
+              ++next)
+            {
               option_pack =
-                std::move(next->unpack_option(current_cmdlist.back()));
+                std::move((*next)->unpack_option(args.front()));
 
               if(option_pack.did_unpack)
                 break;
             }
 
-            if(next != grp.end()) {
+            if(next != option_descs.end()) {
               throw missing_argument_error(option_count,arg_count);
             }
             else {
               auto res = desc->make_value(mapped_key,option_count,arg_count++,
-                current_cmdlist.back(),_vm);
+                args.front(),_vm);
 
               if(!(handles_arg & parse_flag::ignore))
                 _vm.emplace(mapped_key,res);
 
-              current_cmdlist.pop_back();
+              args.pop_front();
             }
           }
         }
 
         // see if there were any packed options
-        if(!option_pack.packed_arguments.empty()) {
-          std::reverse(option_pack.packed_arguments.begin(),
-            option_pack.packed_arguments.end());
-          cmd_stack.emplace_back(std::move(option_pack.packed_arguments));
-        }
+        if(!option_pack.packed_arguments.empty())
+          args.push_frame(std::move(option_pack.packed_arguments));
+
+        if(!option_pack.packed_flags.empty())
+          args.push_flags(std::move(option_pack.packed_flags));
 
         ++option_count;
         ++arg_count;
 
-        if(handles_arg & parse_flag::terminate) {
-          std::advance(first,(nargs-cmd_stack[0].size())-1);
-          return {first,_vm};
-        }
+        if(handles_arg & parse_flag::terminate)
+          return {args.position(),std::move(_vm)};
 
         state = 0;
       } break;
@@ -1258,54 +1772,33 @@ parse_incremental_arguments(BidirectionalIterator first,
         throw unknown_option_error(option_count,arg_count);
       } break;
 
-
-      case 3:
-        // note the fall through so only execute case 4 once
+      case 3: {
+        // single operand, return to looking for options afterwards
         state = 0;
-        [[BFS_FALLTHROUGH]];
-
-      case 4: {
-        // operand, if end_of_option is set, then we continually repeat here
-        arg = std::move(current_cmdlist.back());
-        current_cmdlist.pop_back();
-
-        // always process as operand, try to find desc to handle it
-        for(desc = grp.begin(); desc != grp.end(); ++desc) {
-          if(desc->unpack_option || !desc->mapped_key)
-            continue;
-
-          handles_arg = parse_flag::reject;
-          std::tie(handles_arg,mapped_key) =
-            desc->mapped_key(string_type(),operand_count,arg_count,_vm);
-
-          if(handles_arg == parse_flag::reject)
-            continue;
-
-          // handle this operand
-          if(desc->make_value) {
-            auto res =
-              desc->make_value(mapped_key,operand_count,arg_count,arg,_vm);
-            if(!(handles_arg & parse_flag::ignore))
-              _vm.emplace(mapped_key,res);
-          }
-          else if(!(handles_arg & parse_flag::ignore))
-            _vm.emplace(mapped_key,any());
-
-          ++operand_count;
 
-          break;
-        }
+        arg = std::move(args.front());
+        args.pop_front();
 
-        if(desc == grp.end())
-          throw unexpected_operand_error(operand_count,arg_count);
+        add_operand(_vm.end());
 
-        ++arg_count;
+        if(handles_arg & parse_flag::terminate)
+          return {args.position(),std::move(_vm)};
+      } break;
 
-        if(handles_arg & parse_flag::terminate) {
-          std::advance(first,(nargs-cmd_stack[0].size())-1);
-          return {first,_vm};
+      case 4: {
+        // end_of_options was given at the top level so everything left in
+        // the argument range is an operand. Process the tail here in one
+        // pass rather than returning to the state machine for each one.
+        vm_iterator hint = _vm.end();
+        while(!args.frame_empty()) {
+          arg = std::move(args.front());
+          args.pop_front();
+
+          hint = add_operand(hint);
+
+          if(handles_arg & parse_flag::terminate)
+            return {args.position(),std::move(_vm)};
         }
-
       } break;
 
       default:
@@ -1313,7 +1806,7 @@ parse_incremental_arguments(BidirectionalIterator first,
     }
   }
 
-  return {last,_vm};
+  return {last,std::move(_vm)};
 }
 
 /*
@@ -1547,6 +2040,20 @@ class basic_constraint {
       return *this;
     }
 
+    bool is_lazy(void) const {
+      return _lazy;
+    }
+
+    /*
+      Operands only. Store the operands by their location in the argument
+      range and convert them when visited rather than when parsed. See
+      `basic_operand_range` and `for_each_value`
+    */
+    basic_constraint<CharT> & lazy(bool value = true) {
+      _lazy = value;
+      return *this;
+    }
+
     const std::vector<string_type> & mutually_exclusive(void) const {
       return _mutually_exclusive;
     }
@@ -1600,6 +2107,7 @@ class basic_constraint {
 
     bool _preempt = false;
     bool _ignore = false;
+    bool _lazy = false;
 
     std::vector<string_type> _mutually_exclusive;
     std::vector<string_type> _mutually_exclusive_any;
@@ -1791,27 +2299,158 @@ struct convert_value<char32_t> {
   }
 };
 
-template<typename T, typename CharT>
-class basic_value {
-  public:
-    typedef T value_type;
+namespace detail {
 
-    typedef T (*from_string_fn)(const std::basic_string<CharT> &);
-    typedef void(*to_string_fn)(std::basic_string<CharT> &s, const T&);
+template<typename T>
+struct has_equal {
+  template<typename U>
+  static auto test(int) -> decltype(
+    std::declval<const U &>() == std::declval<const U &>(),std::true_type());
 
+  template<typename>
+  static std::false_type test(...);
 
-    basic_value(void) = default;
-    basic_value(T *_val) :_callback([=](const T &val){*_val = val;}) {}
-    basic_value(const std::function<void(const T &)> &callback)
-      :_callback(callback) {}
+  static constexpr bool value = decltype(test<T>(0))::value;
+};
 
-    const std::function<void(const T &)> & callback(void) const {
-      return _callback;
-    }
+}
 
-    std::shared_ptr<value_type> implicit(void) const {
-      return _implicit;
-    }
+/*
+  Equality of two parsed values of the same type as used by diff(). By
+  default this is operator== if there is one. Values of types without
+  one always compare unequal so that a diff reports them as changed.
+  Specialize compare_value for your own type similar to convert_value if
+  operator== is missing or is not the equality a diff should use.
+*/
+template<typename T, typename Enable = void>
+struct compare_value {
+  static bool equal(const T &, const T &)
+  {
+    return false;
+  }
+};
+
+template<typename T>
+struct compare_value<T,
+  typename std::enable_if<detail::has_equal<T>::value>::type>
+{
+  static bool equal(const T &lhs, const T &rhs)
+  {
+    return lhs == rhs;
+  }
+};
+
+namespace detail {
+
+typedef bool (*any_equal_fn)(const any &, const any &);
+
+template<typename T>
+bool any_equal(const any &lhs, const any &rhs)
+{
+  return compare_value<T>::equal(any_cast<const T &>(lhs),
+    any_cast<const T &>(rhs));
+}
+
+/*
+  The equality hook of each value type registered so far. The built-in
+  arithmetic and string types are registered from the start.
+*/
+struct value_equal_registry {
+  std::mutex guard;
+  std::unordered_map<std::type_index,any_equal_fn> equal;
+
+  static value_equal_registry & instance(void) {
+    static value_equal_registry registry;
+    return registry;
+  }
+
+  private:
+    value_equal_registry(void) {
+      add<bool>();
+      add<char>();
+      add<signed char>();
+      add<unsigned char>();
+      add<wchar_t>();
+      add<char16_t>();
+      add<char32_t>();
+      add<short>();
+      add<unsigned short>();
+      add<int>();
+      add<unsigned int>();
+      add<long>();
+      add<unsigned long>();
+      add<long long>();
+      add<unsigned long long>();
+      add<float>();
+      add<double>();
+      add<long double>();
+      add<std::string>();
+      add<std::wstring>();
+      add<std::u16string>();
+      add<std::u32string>();
+    }
+
+    template<typename T>
+    void add(void) {
+      equal.emplace(std::type_index(typeid(T)),&any_equal<T>);
+    }
+};
+
+}
+
+/*
+  Register compare_value<T> as the equality of values of type T in a
+  variable map as used by diff(). The built-in arithmetic and string
+  types are already registered. Other types are only compared once
+  registered so that making an option does not require its value type to
+  be comparable. compare_value<T> must compile for a registered T, so
+  specialize it for types such as containers whose operator== is
+  declared but cannot be instantiated.
+*/
+template<typename T>
+void register_value_equal(void)
+{
+  detail::value_equal_registry &registry =
+    detail::value_equal_registry::instance();
+
+  std::lock_guard<std::mutex> lock(registry.guard);
+  registry.equal.emplace(std::type_index(typeid(T)),&detail::any_equal<T>);
+}
+
+template<typename T, typename CharT>
+class basic_value {
+  public:
+    typedef T value_type;
+
+    typedef T (*from_string_fn)(const std::basic_string<CharT> &);
+    typedef void(*to_string_fn)(std::basic_string<CharT> &s, const T&);
+
+
+    basic_value(void) = default;
+    /*
+      Store each parsed value in `*_val`. The store is guarded by a mutex
+      shared by all copies of this value so that descriptions built with
+      it can be used to parse from several threads at once. In that case
+      which thread's value is stored last is unspecified.
+    */
+    basic_value(T *_val) {
+      std::shared_ptr<std::mutex> guard = std::make_shared<std::mutex>();
+      _callback = [=](const T &val) {
+        std::lock_guard<std::mutex> lock(*guard);
+        *_val = val;
+      };
+    }
+
+    basic_value(const std::function<void(const T &)> &callback)
+      :_callback(callback) {}
+
+    const std::function<void(const T &)> & callback(void) const {
+      return _callback;
+    }
+
+    std::shared_ptr<value_type> implicit(void) const {
+      return _implicit;
+    }
 
     basic_value<T,CharT> & implicit(const T &val) {
       _implicit = std::make_shared<T>(val);
@@ -1904,6 +2543,18 @@ class basic_value {
       default_to_string;
 };
 
+/*
+  Out-of-class definitions are required prior to C++17 as the members are
+  odr-used when initializing the std::function defaults
+*/
+template<typename T, typename CharT>
+constexpr typename basic_value<T,CharT>::from_string_fn
+  basic_value<T,CharT>::default_from_string;
+
+template<typename T, typename CharT>
+constexpr typename basic_value<T,CharT>::to_string_fn
+  basic_value<T,CharT>::default_to_string;
+
 template<typename T>
 using value = basic_value<T,char>;
 
@@ -1956,6 +2607,12 @@ struct code_point_traits<char> {
     std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> cvt;
     return cvt.to_bytes(str);
   }
+
+  // true unless c is a continuation byte
+  static bool starts_code_point(char_type c)
+  {
+    return ((static_cast<unsigned char>(c) & 0xC0) != 0x80);
+  }
 };
 
 // UTF16
@@ -1987,6 +2644,12 @@ struct code_point_traits<char16_t> {
     std::wstring_convert<std::codecvt_utf8_utf16<char_type>, char_type> cvt8_16;
     return cvt8_16.from_bytes(utf8);
   }
+
+  // true unless c is the trailing (low) surrogate of a pair
+  static bool starts_code_point(char_type c)
+  {
+    return (c < 0xDC00 || c > 0xDFFF);
+  }
 };
 
 // UTF32
@@ -2006,6 +2669,11 @@ struct code_point_traits<char32_t> {
   {
     return str;
   }
+
+  static bool starts_code_point(char_type)
+  {
+    return true;
+  }
 };
 
 // wchar_t
@@ -2025,8 +2693,19 @@ struct code_point_traits<wchar_t> {
   {
     return str;
   }
+
+  static bool starts_code_point(char_type)
+  {
+    return true;
+  }
 };
 
+/*
+  A description given by a fixed format string, see below
+*/
+template<typename CharT>
+class format_description;
+
 }
 
 
@@ -2109,7 +2788,7 @@ set_default_option_spec(const std::basic_string<CharT> &opt_spec, CharT delim,
 
   // %?V{ <%V%?I{=%I}{}>}{}
 
-  static const string_type arg_suffix{'%','?','V','{',' ','<','%','V','%',
+  const string_type arg_suffix{'%','?','V','{',' ','<','%','V','%',
     '?','I','{','=','%','I','}','{','}','>','}','{','}'};
 
   string_type long_opt;
@@ -2148,10 +2827,9 @@ set_default_option_spec(const std::basic_string<CharT> &opt_spec, CharT delim,
       };
 
     if(!hidden) {
-      desc.key_description = [=](void) {
-        return string_type{'-','-'} + long_opt + delim
-          + string_type{'-'} + short_opt + arg_suffix;
-      };
+      desc.key_description = detail::format_description<CharT>(
+        string_type{'-','-'} + long_opt + delim + string_type{'-'} +
+          short_opt + arg_suffix);
     }
   }
   else if(!long_opt.empty()) {
@@ -2166,9 +2844,8 @@ set_default_option_spec(const std::basic_string<CharT> &opt_spec, CharT delim,
       };
 
     if(!hidden) {
-      desc.key_description = [=](void) {
-        return string_type{'-','-'} + long_opt + arg_suffix;
-      };
+      desc.key_description = detail::format_description<CharT>(
+        string_type{'-','-'} + long_opt + arg_suffix);
     }
   }
   else if(!short_opt.empty()){
@@ -2183,18 +2860,16 @@ set_default_option_spec(const std::basic_string<CharT> &opt_spec, CharT delim,
       };
 
     if(!hidden) {
-      desc.key_description = [=](void) {
-        return string_type{'-'} + short_opt + arg_suffix;
-      };
+      desc.key_description = detail::format_description<CharT>(
+        string_type{'-'} + short_opt + arg_suffix);
     }
   }
   else {
     desc.unpack_option = unpack_gnu<uses_packed_flags,CharT>;
     if(!hidden) {
-      desc.key_description = [=](void) {
-        return string_type{'-','-','*'} + delim + string_type{'-','*'} +
-          arg_suffix;
-      };
+      desc.key_description = detail::format_description<CharT>(
+        string_type{'-','-','*'} + delim + string_type{'-','*'} +
+          arg_suffix);
     }
   }
 
@@ -2208,26 +2883,29 @@ inline void set_default_option_value(const basic_value<T,CharT> &val,
   typedef std::basic_string<CharT> string_type;
   typedef basic_variable_map<CharT> variable_map_type;
 
-  if(!val.description().empty()) {
-    desc.value_description = [=](void) -> string_type {
-      return val.description();
-    };
-  }
+  // The descriptions are formatted and compiled once here rather than
+  // each time the help text is typeset
+  if(!val.description().empty())
+    desc.value_description = detail::format_description<CharT>(
+      val.description());
 
   if(val.implicit()) {
+    std::shared_ptr<T> implicit = val.implicit();
+    std::function<void(const T &)> callback = val.callback();
+
     desc.make_implicit_value = [=](const string_type &,
       const variable_map_type &)
     {
-      if(val.callback())
-        val.callback()(*(val.implicit()));
+      if(callback)
+        callback(*implicit);
 
-      return any(*(val.implicit()));
-    };
-    desc.implicit_value_description = [=](void) {
-      string_type str;
-      val.to_string()(str,*(val.implicit()));
-      return str;
+      return any(*implicit);
     };
+
+    string_type implicit_description;
+    val.to_string()(implicit_description,*implicit);
+    desc.implicit_value_description =
+      detail::format_description<CharT>(implicit_description);
   }
 
   desc.make_value = [=](const string_type &, std::size_t posn,
@@ -2295,6 +2973,28 @@ inline void set_default_operand_value(const basic_value<T,CharT> &val,
   }
 }
 
+/*
+  Defer the conversion of operands handled by \c desc until they are
+  visited. See basic_option_description::make_lazy_value
+*/
+template<typename CharT>
+inline void set_lazy_operand_value(basic_option_description<CharT> &desc)
+{
+  typedef std::basic_string<CharT> string_type;
+  typedef basic_variable_map<CharT> variable_map_type;
+
+  auto make_value = desc.make_value;
+
+  desc.make_lazy_value = [=](const string_type &mapped_key, std::size_t posn,
+    std::size_t argn, const string_type &in_val)
+  {
+    if(!make_value)
+      return any();
+
+    return make_value(mapped_key,posn,argn,in_val,variable_map_type());
+  };
+}
+
 template<typename CharT>
 inline void set_default_operand_key(const std::basic_string<CharT> &key,
   int posn, int argn, basic_option_description<CharT> &desc, bool preempt,
@@ -2330,70 +3030,110 @@ inline void set_default_operand_key(const std::basic_string<CharT> &key,
   }
 }
 
+namespace detail {
+
 /*
-  Used for constraints on options.
+  The finalize function made by set_default_constraints. The keys named
+  by the constraints are kept so that a caller that only finalizes the
+  descriptions of changed keys, such as basic_config_reloader, can find
+  the descriptions whose constraints depend on them.
 */
 template<typename CharT>
-void set_default_constraints(const basic_constraint<CharT> &cnts,
-  basic_option_description<CharT> &desc,
-  const std::basic_string<CharT> &mapped_key)
-{
-  desc.finalize = [=](const basic_variable_map<CharT> &vm) {
-    std::size_t occurrances = vm.count(mapped_key);
-    if(occurrances > cnts.max_occurrence() ||
-      occurrances < cnts.min_occurrence())
-    {
-      throw occurrence_error(detail::asUTF8(mapped_key),cnts.min_occurrence(),
-        cnts.max_occurrence(),occurrances);
+class constraint_check {
+  public:
+    typedef std::basic_string<CharT> string_type;
+
+    constraint_check(const basic_constraint<CharT> &cnts,
+      const string_type &mapped_key) :_cnts(cnts), _mapped_key(mapped_key) {}
+
+    /*
+      True if the constraints refer to \c key other than as the mapped
+      key of this description
+    */
+    bool names(const string_type &key) const {
+      return (has_key(_cnts.mutually_exclusive(),key) ||
+        has_key(_cnts.mutually_inclusive(),key) ||
+        has_key(_cnts.mutually_inclusive_any(),key) ||
+        has_key(_cnts.mutually_exclusive_any(),key));
     }
 
-    if(occurrances) {
-      for(auto &exclusive_key : cnts.mutually_exclusive()) {
-        if(vm.count(exclusive_key) != 0)
-          throw mutually_exclusive_error(detail::asUTF8(mapped_key),
-            detail::asUTF8(exclusive_key));
+    void operator()(const basic_variable_map<CharT> &vm) const {
+      std::size_t occurrances = count_values(_mapped_key,vm);
+      if(occurrances > _cnts.max_occurrence() ||
+        occurrances < _cnts.min_occurrence())
+      {
+        throw occurrence_error(detail::asUTF8(_mapped_key),
+          _cnts.min_occurrence(),_cnts.max_occurrence(),occurrances);
       }
 
-      for(auto &inclusive_key : cnts.mutually_inclusive()) {
-        if(vm.count(inclusive_key) == 0)
-          throw mutually_inclusive_error(detail::asUTF8(mapped_key),
-            detail::asUTF8(inclusive_key));
-      }
+      if(occurrances) {
+        for(auto &exclusive_key : _cnts.mutually_exclusive()) {
+          if(vm.count(exclusive_key) != 0)
+            throw mutually_exclusive_error(detail::asUTF8(_mapped_key),
+              detail::asUTF8(exclusive_key));
+        }
 
-      if(!cnts.mutually_inclusive_any().empty()) {
-        bool contains = false;
-        for(auto &inclusive_any_key : cnts.mutually_inclusive_any()) {
-          if(vm.count(inclusive_any_key) != 0)
-            contains = true;
+        for(auto &inclusive_key : _cnts.mutually_inclusive()) {
+          if(vm.count(inclusive_key) == 0)
+            throw mutually_inclusive_error(detail::asUTF8(_mapped_key),
+              detail::asUTF8(inclusive_key));
         }
 
-        if(!contains) {
-          std::vector<std::string> inclusive_any_keys;
-          for(const auto &elem : cnts.mutually_inclusive_any())
-            inclusive_any_keys.emplace_back(detail::asUTF8(elem));
+        if(!_cnts.mutually_inclusive_any().empty()) {
+          bool contains = false;
+          for(auto &inclusive_any_key : _cnts.mutually_inclusive_any()) {
+            if(vm.count(inclusive_any_key) != 0)
+              contains = true;
+          }
+
+          if(!contains) {
+            std::vector<std::string> inclusive_any_keys;
+            for(const auto &elem : _cnts.mutually_inclusive_any())
+              inclusive_any_keys.emplace_back(detail::asUTF8(elem));
 
-          throw mutually_inclusive_any_error(detail::asUTF8(mapped_key),
-            inclusive_any_keys);
+            throw mutually_inclusive_any_error(detail::asUTF8(_mapped_key),
+              inclusive_any_keys);
+          }
         }
       }
-    }
-    else if(!cnts.mutually_exclusive_any().empty()) {
-      for(const auto &elem : cnts.mutually_exclusive_any()) {
-        if(vm.count(elem))
-          return;
+      else if(!_cnts.mutually_exclusive_any().empty()) {
+        for(const auto &elem : _cnts.mutually_exclusive_any()) {
+          if(vm.count(elem))
+            return;
+        }
+
+        std::vector<std::string> exclusive_any_keys;
+        for(const auto &elem : _cnts.mutually_exclusive_any())
+          exclusive_any_keys.emplace_back(detail::asUTF8(elem));
+
+        throw mutually_exclusive_any_error(detail::asUTF8(_mapped_key),
+          exclusive_any_keys);
       }
+    }
 
-      std::vector<std::string> exclusive_any_keys;
-      for(const auto &elem : cnts.mutually_exclusive_any())
-        exclusive_any_keys.emplace_back(detail::asUTF8(elem));
+  private:
+    basic_constraint<CharT> _cnts;
+    string_type _mapped_key;
 
-      throw mutually_exclusive_any_error(detail::asUTF8(mapped_key),
-        exclusive_any_keys);
+    static bool has_key(const std::vector<string_type> &keys,
+      const string_type &key)
+    {
+      return (std::find(keys.begin(),keys.end(),key) != keys.end());
     }
-  };
-}
+};
 
+}
 
+/*
+  Used for constraints on options.
+*/
+template<typename CharT>
+void set_default_constraints(const basic_constraint<CharT> &cnts,
+  basic_option_description<CharT> &desc,
+  const std::basic_string<CharT> &mapped_key)
+{
+  desc.finalize = detail::constraint_check<CharT>(cnts,mapped_key);
+}
 
 /*
   The following functions are for convenience only. They provide automatic
@@ -2419,7 +3159,8 @@ make_option(const std::basic_string<CharT> &opt_spec,
     set_default_option_spec<true>(opt_spec,delim,desc,
       cnts.will_preempt(),cnts.should_ignore(),false);
 
-  desc.extended_description = [=](void) { return extended_desc; };
+  desc.extended_description =
+    detail::format_description<CharT>(extended_desc);
 
   set_default_constraints(cnts,desc,mapped_key);
 
@@ -2512,7 +3253,8 @@ make_option(const std::basic_string<CharT> &opt_spec,
 
   set_default_option_value(val,desc);
 
-  desc.extended_description = [=](void) { return extended_desc; };
+  desc.extended_description =
+    detail::format_description<CharT>(extended_desc);
 
   set_default_constraints(cnts,desc,mapped_key);
 
@@ -2619,6 +3361,9 @@ make_operand(const std::basic_string<CharT> &mapped_key,
 
   set_default_operand_value(val,desc);
 
+  if(cnts.is_lazy())
+    set_lazy_operand_value(desc);
+
   set_default_operand_key(mapped_key,cnts.at_position(),cnts.at_argument(),
     desc,cnts.will_preempt(),cnts.should_ignore());
 
@@ -2646,6 +3391,9 @@ make_operand(const std::basic_string<CharT> &mapped_key,
 {
   basic_option_description<CharT> desc;
 
+  if(cnts.is_lazy())
+    set_lazy_operand_value(desc);
+
   set_default_operand_key(mapped_key,cnts.at_position(),cnts.at_argument(),
     desc,cnts.will_preempt(),cnts.should_ignore());
 
@@ -2835,6 +3583,244 @@ inline basic_variable_map<CharT> ensure(const basic_variable_map<CharT> &vm1,
   return vm;
 }
 
+/*
+  A stack of variable maps viewed as one without copying them.
+
+  Layers are added from lowest to highest precedence, for example
+  defaults, then configuration files, then the environment, then the
+  command line. Each layer is held by reference and so must outlive this
+  object. How the values of a key given in more than one layer are
+  resolved is set per key:
+
+  - \c overlay [default] The values of the key are those of the highest
+    layer that contains it. This is `overlay(lower,higher)` or
+    equivalently `ensure(higher,lower)`.
+
+  - \c append The values of the key are those of every layer from the
+    lowest to the highest. This is `append(lower,higher)`.
+
+  Lookups resolve through the layers directly. flatten() collapses the
+  stack into a single variable map when one is needed.
+*/
+template<typename CharT>
+class basic_layered_variable_map {
+  public:
+    typedef basic_variable_map<CharT> variable_map_type;
+    typedef typename variable_map_type::key_type key_type;
+
+    enum layer_policy {
+      overlay,
+      append
+    };
+
+    /*
+      Add \c vm as the highest precedence layer
+    */
+    basic_layered_variable_map & push_back(const variable_map_type &vm) {
+      _layers.push_back(&vm);
+      return *this;
+    }
+
+    std::size_t layers(void) const {
+      return _layers.size();
+    }
+
+    basic_layered_variable_map & policy(const key_type &key,
+      layer_policy val)
+    {
+      _policies[key] = val;
+      return *this;
+    }
+
+    layer_policy policy(const key_type &key) const {
+      auto loc = _policies.find(key);
+      return (loc == _policies.end() ? overlay : loc->second);
+    }
+
+    /*
+      The number of values of \c key after resolving the layers
+    */
+    std::size_t count(const key_type &key) const {
+      std::size_t result = 0;
+      for_each_layer(key,[&](const variable_map_type &vm) {
+        result += vm.count(key);
+      });
+      return result;
+    }
+
+    /*
+      The last value of \c key after resolving the layers or null if
+      there is none. This is the value that would be given by
+      `assert_last_value` on the flattened map.
+    */
+    const any * find(const key_type &key) const {
+      for(auto layer = _layers.rbegin(); layer != _layers.rend(); ++layer) {
+        auto &&range = (*layer)->equal_range(key);
+        if(range.first != range.second)
+          return &(std::prev(range.second)->second);
+      }
+
+      return nullptr;
+    }
+
+    /*
+      The values of \c key after resolving the layers in the order they
+      would appear in the flattened map
+    */
+    std::vector<const any *> values(const key_type &key) const {
+      std::vector<const any *> result;
+      for_each_layer(key,[&](const variable_map_type &vm) {
+        auto &&range = vm.equal_range(key);
+        for(; range.first != range.second; ++range.first)
+          result.push_back(&(range.first->second));
+      });
+      return result;
+    }
+
+    /*
+      Collapse the layers into a single variable map
+    */
+    variable_map_type flatten(void) const;
+
+  private:
+    std::vector<const variable_map_type *> _layers;
+    std::map<key_type,layer_policy> _policies;
+
+    /*
+      Call fn with each layer that contributes values of key from lowest
+      to highest
+    */
+    template<typename Fn>
+    void for_each_layer(const key_type &key, const Fn &fn) const {
+      if(policy(key) == append) {
+        for(auto &layer : _layers)
+          fn(*layer);
+        return;
+      }
+
+      for(auto layer = _layers.rbegin(); layer != _layers.rend(); ++layer) {
+        if((*layer)->count(key)) {
+          fn(**layer);
+          return;
+        }
+      }
+    }
+};
+
+template<typename CharT>
+typename basic_layered_variable_map<CharT>::variable_map_type
+basic_layered_variable_map<CharT>::flatten(void) const
+{
+  variable_map_type result;
+
+  for(auto &layer : _layers) {
+    auto cur = layer->begin();
+    while(cur != layer->end()) {
+      auto last = layer->upper_bound(cur->first);
+
+      if(policy(cur->first) == overlay)
+        result.erase(cur->first);
+
+      auto hint = result.upper_bound(cur->first);
+      for(; cur != last; ++cur)
+        result.emplace_hint(hint,*cur);
+    }
+  }
+
+  return result;
+}
+
+typedef basic_layered_variable_map<char> layered_variable_map;
+typedef basic_layered_variable_map<wchar_t> wlayered_variable_map;
+typedef basic_layered_variable_map<char16_t> layered_variable_map16;
+typedef basic_layered_variable_map<char32_t> layered_variable_map32;
+
+/*
+  The keys that differ between two variable maps. Each list is sorted.
+*/
+template<typename CharT>
+struct basic_variable_map_diff {
+  typedef std::basic_string<CharT> string_type;
+
+  std::vector<string_type> added;
+  std::vector<string_type> removed;
+  std::vector<string_type> changed;
+
+  bool empty(void) const {
+    return added.empty() && removed.empty() && changed.empty();
+  }
+};
+
+typedef basic_variable_map_diff<char> variable_map_diff;
+typedef basic_variable_map_diff<wchar_t> wvariable_map_diff;
+
+/*
+  The keys that were added, removed, or changed going from \c vm_old to
+  \c vm_new. A key is changed if it has a different number of values or
+  if any of its values differ from the value at the same position as
+  given by compare_value. Values of a type with no registered equality
+  (see register_value_equal) are considered changed. The maps are walked
+  together once in key order.
+*/
+template<typename CharT>
+basic_variable_map_diff<CharT>
+diff(const basic_variable_map<CharT> &vm_old,
+  const basic_variable_map<CharT> &vm_new)
+{
+  basic_variable_map_diff<CharT> result;
+
+  detail::value_equal_registry &registry =
+    detail::value_equal_registry::instance();
+  std::lock_guard<std::mutex> lock(registry.guard);
+
+  auto equal = [&](const any &lhs, const any &rhs) {
+    if(is_empty(lhs) || is_empty(rhs))
+      return is_empty(lhs) && is_empty(rhs);
+
+    if(lhs.type() != rhs.type())
+      return false;
+
+    auto loc = registry.equal.find(std::type_index(lhs.type()));
+    return (loc != registry.equal.end() && loc->second(lhs,rhs));
+  };
+
+  auto old_cur = vm_old.begin();
+  auto new_cur = vm_new.begin();
+  while(old_cur != vm_old.end() || new_cur != vm_new.end()) {
+    if(new_cur == vm_new.end() ||
+      (old_cur != vm_old.end() && old_cur->first < new_cur->first))
+    {
+      result.removed.push_back(old_cur->first);
+      old_cur = vm_old.upper_bound(old_cur->first);
+    }
+    else if(old_cur == vm_old.end() || new_cur->first < old_cur->first) {
+      result.added.push_back(new_cur->first);
+      new_cur = vm_new.upper_bound(new_cur->first);
+    }
+    else {
+      const auto &key = old_cur->first;
+      bool changed = false;
+      for(; old_cur != vm_old.end() && old_cur->first == key; ++old_cur) {
+        if(new_cur == vm_new.end() || new_cur->first != key ||
+          !equal(old_cur->second,new_cur->second))
+        {
+          changed = true;
+          break;
+        }
+        ++new_cur;
+      }
+
+      if(changed || (new_cur != vm_new.end() && new_cur->first == key))
+        result.changed.push_back(key);
+
+      old_cur = vm_old.upper_bound(key);
+      new_cur = vm_new.upper_bound(key);
+    }
+  }
+
+  return result;
+}
+
 
 
 
@@ -2845,55 +3831,79 @@ namespace detail {
 template<typename CharT>
 inline bool is_C_space(CharT c)
 {
-  static const std::array<CharT,6> C_space{{0x20,0x0c,0x0a,0x0d,0x09,0x0b}};
+  // space, or one of \t \n \v \f \r
+  return (c == 0x20 || (c >= 0x09 && c <= 0x0d));
+}
 
-  return (std::find(C_space.begin(),C_space.end(),c) != C_space.end());
+
+/*
+  The number of code points in [first,last)
+*/
+template<typename CharT, typename ForwardIterator>
+inline std::size_t code_point_width(ForwardIterator first,
+  ForwardIterator last)
+{
+  std::size_t width = 0;
+  for(; first != last; ++first)
+    width += code_point_traits<CharT>::starts_code_point(*first);
+
+  return width;
 }
 
+/*
+  Wrap text to max_width code points. Leading whitespace of each line in
+  the input is kept, otherwise words are separated by a single space.
 
+  Works directly on the UTF-8, UTF-16, or UTF-32 encoded text. Only the
+  width of each word is counted in code points; whitespace is always a
+  single code unit so the text never needs to be converted.
+*/
 template<typename CharT>
 std::basic_string<CharT>
 wrap(const std::basic_string<CharT> &text, std::size_t max_width)
 {
   typedef std::basic_string<CharT> string_type;
+  typedef typename string_type::const_iterator const_iterator;
 
   string_type wrapped;
-  string_type word;
+  wrapped.reserve(text.size()+text.size()/(max_width ? max_width : 1)+1);
 
   std::size_t width = 0;
   bool ignore_ws = false;
-  auto cur = text.begin();
+  const_iterator cur = text.begin();
   while(cur != text.end()) {
     if(ignore_ws) {
       // eat all whitespace until find non-whitespace or newline
       while(cur != text.end() && is_C_space(*cur) && *cur != '\n')
         ++cur;
 
-      if(*cur == '\n') {
-        wrapped += *cur++;
+      if(cur != text.end() && *cur == '\n') {
+        wrapped.push_back(*cur++);
         width = 0;
         ignore_ws = false;
         continue;
       }
 
-      // read complete word
+      // find complete word
+      const_iterator word_begin = cur;
       while(cur != text.end() && !is_C_space(*cur))
-        word += *cur++;
+        ++cur;
+
+      std::size_t word_width = code_point_width<CharT>(word_begin,cur);
 
-      if(width + word.size() + 1 > max_width) {
-        wrapped += '\n';
+      if(width + word_width + 1 > max_width) {
+        wrapped.push_back('\n');
         width = 0;
       }
       else if(width != 0) {
-        wrapped += ' ';
+        wrapped.push_back(' ');
         ++width;
       }
-      wrapped += word;
-      width += word.size();
-      word.clear();
+      wrapped.append(word_begin,cur);
+      width += word_width;
 
-      if(*cur == '\n') {
-        wrapped += *cur++;
+      if(cur != text.end() && *cur == '\n') {
+        wrapped.push_back(*cur++);
         width = 0;
         ignore_ws = false;
       }
@@ -2902,10 +3912,10 @@ wrap(const std::basic_string<CharT> &text, std::size_t max_width)
       // do not ignore whitespace
       while(cur != text.end() && is_C_space(*cur)) {
         if(width+1 > max_width) {
-          wrapped += '\n';
+          wrapped.push_back('\n');
           width = 0;
         }
-        wrapped += *cur++;
+        wrapped.push_back(*cur++);
         ++width;
       }
 
@@ -2977,165 +3987,351 @@ wrap(const std::basic_string<CharT> &text, std::size_t max_width)
   The purpose of the substitutions is to accomodate other languages
   while easily reformatting the output.
 
-  do_expand parses up to last or '}' expanding along the way
+  Format strings are compiled once into a `format_program`, a flat list
+  of literal runs, substitutions, and conditional branches, that is then
+  rendered by walking the list and appending to a single output string.
+  The only clause of an OPT_SUBS that is rendered is the one selected.
 */
 template<typename CharT>
-std::pair<typename std::basic_string<CharT>::const_iterator,
-  std::basic_string<CharT> >
-do_expand(typename std::basic_string<CharT>::const_iterator first,
-  typename std::basic_string<CharT>::const_iterator cur,
-  typename std::basic_string<CharT>::const_iterator last,
-  const std::function<std::basic_string<CharT>(void)> &key_desc,
-  const std::function<std::basic_string<CharT>(void)> &value_desc,
-  const std::function<std::basic_string<CharT>(void)> &imp_value_desc,
-  const std::function<std::basic_string<CharT>(void)> &ext_desc,
-  std::vector<CharT> &stack)
-{
-  typedef std::basic_string<CharT> string_type;
+class format_program {
+  public:
+    typedef std::basic_string<CharT> string_type;
+    typedef typename string_type::const_iterator const_iterator;
+    typedef std::function<string_type(void)> description_fn;
 
-  string_type result;
+    /*
+      Compile [cur,last) up to last or an unmatched '}'. Error positions
+      are given relative to first. Returns the location where compilation
+      stopped.
+    */
+    const_iterator compile(const_iterator first, const_iterator cur,
+      const_iterator last)
+    {
+      while(cur != last) {
+        // find first occurrence of non-escaped '%' checking for valid
+        // escape sequences and incorrect brackets along the way
+        std::size_t text_begin = _text.size();
+        while(cur != last && *cur != '%') {
+          if(*cur == '\\') {
+            ++cur;
+
+            if(cur == last ||
+              (*cur != '{' && *cur != '}' && *cur != '\\' && *cur != '%'))
+            {
+              throw formatter_error("invalid formatter escape sequence",
+                std::distance(first,cur));
+            }
+          }
+          else if(*cur == '{') {
+            throw formatter_error(
+              "formatter clause brackets can only be used with %?",
+              std::distance(first,cur));
+          }
+          else if(*cur == '}')
+            break;
 
-  while(cur != last) {
-    // find first occurrence of non-escaped '%' checking for valid
-    // escape sequences and incorrect brackets along the way
-    while(cur != last && *cur != '%') {
-      if(*cur == '\\') {
-        ++cur;
+          _text.push_back(*cur++);
+        }
 
-        if(cur == last ||
-          (*cur != '{' && *cur != '}' && *cur != '\\' && *cur != '%'))
-        {
-          throw formatter_error("invalid formatter escape sequence",
+        if(_text.size() != text_begin)
+          emit(literal,0,text_begin,_text.size());
+
+        if(cur == last || *cur == '}')
+          return cur;
+
+        // cur == '%', if ++cur is end, then invalid replacement seq
+        if(++cur == last) {
+          throw formatter_error(
+            "unexpected end during formatter substitution",
             std::distance(first,cur));
         }
+
+        if(*cur == '?') {
+          if(++cur == last || !is_subs(*cur)) {
+            throw formatter_error(
+              "invalid formatter substitution (one of K,V,I,E)",
+              std::distance(first,cur));
+          }
+
+          std::size_t branch_pc = emit(branch,*cur,0,0);
+
+          if(++cur == last || *cur != '{') {
+            throw formatter_error(
+              "%? expansions must be followed by '{' true_expansion '}{'"
+                " false_expansion '}'",
+              std::distance(first,cur));
+          }
+
+          cur = compile(first,++cur,last);
+
+          if(cur == last || ++cur == last || *cur != '{') {
+            throw formatter_error(
+              "%? expansions must be followed by '{' true_expansion '}{'"
+                " false_expansion '}'",
+              std::distance(first,cur));
+          }
+
+          std::size_t jump_pc = emit(jump,0,0,0);
+          _program[branch_pc].target = _program.size();
+
+          cur = compile(first,++cur,last);
+
+          if(cur == last) {
+            throw formatter_error(
+              "unexpected end during formatter substitution",
+              std::distance(first,cur));
+          }
+
+          _program[jump_pc].target = _program.size();
+
+          ++cur;
+        }
+        else {
+          if(!is_subs(*cur)) {
+            throw formatter_error(
+              "invalid formatter substitution (one of K,V,I,E)",
+              std::distance(first,cur));
+          }
+
+          emit(substitute,*cur,std::distance(first,cur),0);
+
+          ++cur;
+        }
       }
-      else if(*cur == '{') {
+
+      return cur;
+    }
+
+    /*
+      Compile all of str. An unmatched '}' is an error.
+    */
+    void compile(const string_type &str) {
+      const_iterator stop = compile(str.begin(),str.begin(),str.end());
+
+      if(stop != str.end()) {
         throw formatter_error(
           "formatter clause brackets can only be used with %?",
-          std::distance(first,cur));
+          std::distance(str.begin(),stop));
       }
-      else if(*cur == '}')
-        return {cur,std::move(result)};
-
-      result.push_back(*cur++);
     }
 
-    if(cur == last)
-      return {cur,std::move(result)};
+    /*
+      Append the rendered program to out. The value of each substitution
+      is itself a format string. `compile_fn` is given the description
+      function of the substitution and returns its program as a
+      `std::shared_ptr<const format_program>` which is rendered in place.
+      `stack` holds the substitutions currently being rendered to detect
+      recursion.
+    */
+    template<typename CompileFn>
+    void render(string_type &out, const description_fn &key_desc,
+      const description_fn &value_desc, const description_fn &imp_value_desc,
+      const description_fn &ext_desc, std::vector<CharT> &stack,
+      const CompileFn &compile_fn) const
+    {
+      out.reserve(out.size()+_text.size());
 
-    // cur == '%', if ++cur is end, then invalid replacement seq
-    if(++cur == last) {
-      throw formatter_error(
-        "unexpected end during formatter substitution",
-        std::distance(first,cur));
-    }
+      std::size_t pc = 0;
+      while(pc < _program.size()) {
+        const instruction &inst = _program[pc++];
 
-    if(*cur == '?') {
-      if(++cur == last ||
-        (*cur != 'K' && *cur != 'V' && *cur != 'I' && *cur != 'E'))
-      {
-        throw formatter_error(
-          "invalid formatter substitution (one of K,V,I,E)",
-          std::distance(first,cur));
-      }
+        switch(inst.op) {
+          case literal:
+            out.append(_text,inst.first,inst.last-inst.first);
+            break;
 
-      bool exists =
-        (*cur == 'K' && key_desc) ||
-        (*cur == 'V' && value_desc) ||
-        (*cur == 'I' && imp_value_desc) ||
-        (*cur == 'E' && ext_desc);
+          case branch:
+            if(!select(inst.which,key_desc,value_desc,imp_value_desc,
+              ext_desc))
+            {
+              pc = inst.target;
+            }
+            break;
 
-      if(++cur == last || *cur != '{') {
-        throw formatter_error(
-          "%? expansions must be followed by '{' true_expansion '}{'"
-            " false_expansion '}'",
-          std::distance(first,cur));
-      }
+          case jump:
+            pc = inst.target;
+            break;
 
+          case substitute: {
+            if(std::find(stack.begin(),stack.end(),inst.which) != stack.end())
+            {
+              throw formatter_error(
+                "recursive formatter_expansion",inst.first);
+            }
 
-      string_type true_clause;
-      std::tie(cur,true_clause) = do_expand(first,++cur,last,key_desc,
-        value_desc,imp_value_desc,ext_desc,stack);
+            stack.push_back(inst.which);
 
-      if(cur == last || *(++cur) != '{') {
-        throw formatter_error(
-          "%? expansions must be followed by '{' true_expansion '}{'"
-            " false_expansion '}'",
-          std::distance(first,cur));
-      }
+            const description_fn &fn =
+              select(inst.which,key_desc,value_desc,imp_value_desc,ext_desc);
 
-      string_type false_clause;
-      std::tie(cur,false_clause) = do_expand(first,++cur,last,key_desc,
-        value_desc,imp_value_desc,ext_desc,stack);
+            try {
+              if(fn) {
+                std::shared_ptr<const format_program> subs = compile_fn(fn);
+                subs->render(out,key_desc,value_desc,imp_value_desc,ext_desc,
+                  stack,compile_fn);
+              }
+            }
+            catch (...) {
+              std::throw_with_nested(formatter_error("expansion failed",
+                inst.first));
+            }
 
-      if(cur == last) {
-        throw formatter_error(
-          "unexpected end during formatter substitution",
-          std::distance(first,cur));
+            stack.pop_back();
+          } break;
+        }
       }
+    }
 
-      if(exists)
-        result.append(true_clause);
-      else
-        result.append(false_clause);
+    /*
+      Append the literal text outside of any %? clause, that is the text
+      rendered whatever the descriptions are without its substitutions.
+    */
+    void fixed_text(string_type &out) const {
+      std::size_t pc = 0;
+      while(pc < _program.size()) {
+        const instruction &inst = _program[pc++];
+
+        if(inst.op == literal)
+          out.append(_text,inst.first,inst.last-inst.first);
+        else if(inst.op == branch) {
+          // the jump ending the true clause goes past the false clause
+          pc = _program[inst.target-1].target;
+        }
+      }
+    }
 
-      ++cur;
+  private:
+    enum opcode {
+      literal,    // append _text[first,last)
+      substitute, // expand which, first is the source position
+      branch,     // if which is not present go to target
+      jump        // go to target
+    };
 
+    struct instruction {
+      opcode op;
+      CharT which;
+      std::size_t first;
+      std::size_t last;
+      std::size_t target;
+    };
+
+    static bool is_subs(CharT c) {
+      return (c == 'K' || c == 'V' || c == 'I' || c == 'E');
     }
-    else {
-      if(*cur != 'K' && *cur != 'V' && *cur != 'I' && *cur != 'E') {
-        throw formatter_error(
-          "invalid formatter substitution (one of K,V,I,E)",
-          std::distance(first,cur));
-      }
 
-      if(std::find(stack.begin(),stack.end(),*cur) != stack.end()) {
-        throw formatter_error(
-          "recursive formatter_expansion",
-          std::distance(first,cur));
-      }
+    static const description_fn &
+    select(CharT which, const description_fn &key_desc,
+      const description_fn &value_desc, const description_fn &imp_value_desc,
+      const description_fn &ext_desc)
+    {
+      if(which == 'K')
+        return key_desc;
+      if(which == 'V')
+        return value_desc;
+      if(which == 'I')
+        return imp_value_desc;
+      return ext_desc;
+    }
 
-      stack.push_back(*cur);
+    std::size_t emit(opcode op, CharT which, std::size_t first,
+      std::size_t last)
+    {
+      _program.push_back(instruction{op,which,first,last,0});
+      return _program.size()-1;
+    }
 
-      string_type str;
-      if(*cur == 'K' && key_desc)
-        str = key_desc();
-      else if(*cur == 'V' && value_desc)
-        str = value_desc();
-      else if(*cur == 'I' && imp_value_desc)
-        str = imp_value_desc();
-      else if(*cur == 'E' && ext_desc)
-        str = ext_desc();
+    std::vector<instruction> _program;
+    string_type _text;
+};
 
-      string_type subs_str;
-      try {
-        typename string_type::const_iterator subs_end;
+/*
+  A description given by a fixed format string. The string is compiled
+  when the description is made by the make_option family so that
+  typesetting the help text only renders the compiled program. Formatters
+  recover the program through std::function::target. A string that does
+  not compile is kept uncompiled so that the error is reported when it is
+  typeset, as it is for any other description.
+*/
+template<typename CharT>
+class format_description {
+  public:
+    typedef std::basic_string<CharT> string_type;
+    typedef format_program<CharT> program_type;
 
-        std::tie(subs_end,subs_str) =
-          do_expand(str.begin(),str.begin(),str.end(),key_desc,
-            value_desc,imp_value_desc,ext_desc,stack);
+    explicit format_description(const string_type &str) :_str(str) {
+      std::shared_ptr<program_type> program = std::make_shared<program_type>();
 
-        if(subs_end != str.end()) {
-          throw formatter_error(
-            "formatter clause brackets can only be used with %?",
-            std::distance(str.cbegin(),subs_end));
-        }
+      try {
+        program->compile(_str);
+        _program = std::move(program);
       }
-      catch (...) {
-        std::throw_with_nested(formatter_error("expansion failed",
-          std::distance(first,cur)));
+      catch (const formatter_error &) {
       }
+    }
 
+    string_type operator()(void) const {
+      return _str;
+    }
 
-      result.append(subs_str);
-      stack.pop_back();
-
-      ++cur;
+    const std::shared_ptr<const program_type> & program(void) const {
+      return _program;
     }
 
-  }
+  private:
+    string_type _str;
+    std::shared_ptr<const program_type> _program;
+};
+
+/*
+  The compiled program of the description given by fn. Descriptions made
+  by the make_option family carry their program, any other is compiled
+  here.
+*/
+template<typename CharT>
+std::shared_ptr<const format_program<CharT> >
+description_program(const std::function<std::basic_string<CharT>(void)> &fn)
+{
+  typedef format_program<CharT> program_type;
+
+  const format_description<CharT> *fmt =
+    fn.template target<format_description<CharT> >();
+  if(fmt && fmt->program())
+    return fmt->program();
 
-  return {cur,result};
+  std::shared_ptr<program_type> program = std::make_shared<program_type>();
+  program->compile(fn());
+
+  return program;
+}
+
+/*
+  do_expand parses up to last or '}' expanding along the way. Formats
+  given as substitutions are compiled as they are encountered.
+*/
+template<typename CharT>
+std::pair<typename std::basic_string<CharT>::const_iterator,
+  std::basic_string<CharT> >
+do_expand(typename std::basic_string<CharT>::const_iterator first,
+  typename std::basic_string<CharT>::const_iterator cur,
+  typename std::basic_string<CharT>::const_iterator last,
+  const std::function<std::basic_string<CharT>(void)> &key_desc,
+  const std::function<std::basic_string<CharT>(void)> &value_desc,
+  const std::function<std::basic_string<CharT>(void)> &imp_value_desc,
+  const std::function<std::basic_string<CharT>(void)> &ext_desc,
+  std::vector<CharT> &stack)
+{
+  typedef std::basic_string<CharT> string_type;
+  typedef format_program<CharT> program_type;
+
+  program_type program;
+  cur = program.compile(first,cur,last);
+
+  string_type result;
+  program.render(result,key_desc,value_desc,imp_value_desc,ext_desc,stack,
+    description_program<CharT>);
+
+  return {cur,std::move(result)};
 }
 
 /*
@@ -3164,6 +4360,20 @@ expand(const std::basic_string<CharT> &in,
   return result.second;
 }
 
+/*
+  Expand the description given by fn and append the result to out
+*/
+template<typename CharT>
+inline void expand(std::basic_string<CharT> &out,
+  const std::function<std::basic_string<CharT>(void)> &fn,
+  const basic_option_description<CharT> &desc)
+{
+  std::vector<CharT> stack;
+  description_program(fn)->render(out,desc.key_description,
+    desc.value_description,desc.implicit_value_description,
+    desc.extended_description,stack,description_program<CharT>);
+}
+
 }
 
 /*
@@ -3173,8 +4383,23 @@ expand(const std::basic_string<CharT> &in,
   containing the fully formatted option or the empty string if the
   option should be hidden.
 
+  \c write_description [OPTIONAL] Append the fully formatted option to
+  \c out. Defaults to appending the result of typeset_description.
+  Formatters that can typeset in place should override this to avoid the
+  intermediate string.
+
   \c compare [OPTIONAL] Calls do_compare(). May return an empty
   compare_type to indicate sorting should not be performed
+
+  \c sort_key [OPTIONAL] Return a function that gives the key that each
+  entry should be sorted by. When provided it is used instead of \c
+  compare and is called once per entry rather than once per comparison,
+  so a formatter that provides both must order entries the same way with
+  either. May return an empty sort_key_type to indicate that \c compare
+  should be used instead.
+
+  In either case the sort is stable so entries that compare equal are
+  given in the order they appear in the group.
 */
 template<typename CharT>
 class basic_description_formatter {
@@ -3185,14 +4410,27 @@ class basic_description_formatter {
     typedef std::function<bool(const description_type &,
       const description_type &)> compare_type;
 
+    typedef std::function<string_type(const description_type &)>
+      sort_key_type;
+
     virtual ~basic_description_formatter(void) {}
 
     virtual string_type
       typeset_description(const description_type &desc) const = 0;
 
+    virtual void write_description(string_type &out,
+      const description_type &desc) const
+    {
+      out.append(typeset_description(desc));
+    }
+
     virtual compare_type compare(void) const {
       return compare_type();
     }
+
+    virtual sort_key_type sort_key(void) const {
+      return sort_key_type();
+    }
 };
 
 
@@ -3203,6 +4441,11 @@ class basic_description_formatter {
   into two columns (default 30 characters). If the first column is too
   wide, then the second column is started on a new line.
 
+  Descriptions made by the make_option family carry their compiled
+  format strings so the formatter itself holds no state while typesetting.
+  Derived formatters change how entries are typeset by overriding
+  write_description, typeset_description returns what it appends.
+
   First form:
 
   key_description [column_pad] extended_description
@@ -3212,9 +4455,12 @@ class basic_description_formatter {
   key_desciption [newline]
   [key_column_width] [column_pad] extended_description [newline]
 
-  Sorts the option_descriptions by key_description() if both are
-  present. If only rhs.key_description is present, returns true,
-  otherwise returns false.
+  If sort_entries(true), sorts the option_descriptions by
+  key_description(). The comparator returned by compare() does this: if
+  only rhs.key_description is present, it returns true, otherwise it
+  returns false. sort_key() gives the same order with each key computed
+  once and is preferred, so a derived formatter that overrides compare()
+  must also override sort_key(), either to match it or to return nothing.
 */
 template<typename CharT>
 class basic_default_formatter : public basic_description_formatter<CharT> {
@@ -3222,8 +4468,19 @@ class basic_default_formatter : public basic_description_formatter<CharT> {
     using typename basic_description_formatter<CharT>::string_type;
     using typename basic_description_formatter<CharT>::description_type;
     using typename basic_description_formatter<CharT>::compare_type;
+    using typename basic_description_formatter<CharT>::sort_key_type;
 
-    string_type typeset_description(const description_type &desc) const;
+    string_type typeset_description(const description_type &desc) const {
+      string_type out;
+      this->write_description(out,desc);
+      return out;
+    }
+
+    void write_description(string_type &out,
+      const description_type &desc) const
+    {
+      typeset(out,desc);
+    }
 
     void sort_entries(bool val) {
       _should_sort = val;
@@ -3250,6 +4507,17 @@ class basic_default_formatter : public basic_description_formatter<CharT> {
       return compare_type();
     }
 
+    sort_key_type sort_key(void) const {
+      if(_should_sort) {
+        return [](const description_type &desc) {
+          return (desc.key_description ? desc.key_description() :
+            string_type());
+        };
+      }
+
+      return sort_key_type();
+    }
+
     virtual void key_column_indent(std::size_t n) {
       _key_indent = n;
     }
@@ -3284,29 +4552,21 @@ class basic_default_formatter : public basic_description_formatter<CharT> {
 
     virtual string_type wrap(const string_type &str) const
     {
-      typedef detail::code_point_traits<CharT> cpoint_traits;
-      typedef std::basic_string<typename cpoint_traits::code_point>
-            cpstring_type;
-
-      cpstring_type cpextended_desc = cpoint_traits::convert_from(str);
-      cpstring_type wrapped_text = detail::wrap(cpextended_desc,max_width());
-
-      return cpoint_traits::convert_to(wrapped_text);
+      return detail::wrap(str,max_width());
     }
 
     virtual string_type wrap(const string_type &str,
       std::size_t width) const
     {
-      typedef detail::code_point_traits<CharT> cpoint_traits;
-      typedef std::basic_string<typename cpoint_traits::code_point>
-            cpstring_type;
-
-      cpstring_type cpextended_desc = cpoint_traits::convert_from(str);
-      cpstring_type wrapped_text = detail::wrap(cpextended_desc,width);
-
-      return cpoint_traits::convert_to(wrapped_text);
+      return detail::wrap(str,width);
     }
 
+  protected:
+    /*
+      Append the typeset desc to out
+    */
+    void typeset(string_type &out, const description_type &desc) const;
+
   private:
     bool _should_sort = false;
     std::size_t _key_indent = 2;
@@ -3332,94 +4592,149 @@ class basic_default_formatter : public basic_description_formatter<CharT> {
   (width-indent) whereas in a single column (or paragraph-mode), the
   first line starts at indent and is (width-indent) wide.
 
-  All text processing is done as UTF32 by converting the given CharT for
-  wrapping and indenting and then converting back again. Although this
-  adds a conversion and copy step, it is cleaner than multiple
-  implementations that handle the different UTF{8,16,32} and wchar_t
-  possibilities.
+  Text is wrapped and indented in its given encoding. Widths are counted
+  in code points using code_point_traits so UTF{8,16} text does not need
+  to be converted to UTF32 and back again.
 */
 template<typename CharT>
-typename basic_default_formatter<CharT>::string_type
-basic_default_formatter<CharT>::
-  typeset_description(const description_type &desc) const
+void basic_default_formatter<CharT>::
+  typeset(string_type &out, const description_type &desc) const
 {
   if(!desc.key_description)
-    return string_type();
+    return;
 
-  string_type key_col =
-    string_type(key_column_indent(),static_cast<CharT>(' ')) +
-    detail::expand(desc.key_description(),desc);
+  std::size_t key_begin = out.size();
+  out.append(key_column_indent(),static_cast<CharT>(' '));
+  detail::expand(out,desc.key_description,desc);
 
-  if(key_col.size() > key_column_width()) {
-    key_col.push_back('\n');
-    key_col.append(key_column_width()+column_pad(),static_cast<CharT>(' '));
-  }
-  else {
-    std::size_t per_pad = key_column_width()+column_pad()-key_col.size();
-    key_col.append(per_pad,' ');
+  std::size_t indent = key_column_width()+column_pad();
+  std::size_t key_size =
+    detail::code_point_width<CharT>(out.begin()+key_begin,out.end());
+  if(key_size > key_column_width()) {
+    out.push_back('\n');
+    out.append(indent,static_cast<CharT>(' '));
   }
+  else
+    out.append(indent-key_size,static_cast<CharT>(' '));
 
-  std::size_t indent = key_column_width()+column_pad();
-  string_type wrapped_desc;
   if(desc.extended_description) {
-    string_type ext_desc_col =
-      detail::expand(desc.extended_description(),desc);
+    string_type ext_desc_col;
+    detail::expand(ext_desc_col,desc.extended_description,desc);
 
-    wrapped_desc = wrap(ext_desc_col,max_width()-indent);
+    string_type wrapped_desc = wrap(ext_desc_col,max_width()-indent);
 
-    typename string_type::size_type pos =
-      wrapped_desc.find(static_cast<CharT>('\n'));
-    while(pos != string_type::npos) {
-      wrapped_desc.insert(++pos,indent,static_cast<CharT>(' '));
-      pos = wrapped_desc.find(static_cast<CharT>('\n'),pos+indent);
+    // indent each subsequent line in a single pass
+    std::size_t lines = static_cast<std::size_t>(
+      std::count(wrapped_desc.begin(),wrapped_desc.end(),
+        static_cast<CharT>('\n')));
+    out.reserve(out.size()+wrapped_desc.size()+lines*indent);
+
+    for(auto &c : wrapped_desc) {
+      out.push_back(c);
+      if(c == '\n')
+        out.append(indent,static_cast<CharT>(' '));
     }
   }
-
-  key_col.append(wrapped_desc);
-
-  return key_col;
 }
 
+namespace detail {
+
+/*
+  The visible descriptions in grp in the order requested by fmt
+*/
 template<typename CharT>
-std::basic_string<CharT>
-to_string(const std::vector<basic_option_description<CharT> > &grp,
-  const basic_description_formatter<CharT> &fmt =
-    basic_default_formatter<CharT>())
+std::vector<const basic_option_description<CharT> *>
+help_entries(const std::vector<basic_option_description<CharT> > &grp,
+  const basic_description_formatter<CharT> &fmt)
 {
-  typedef std::basic_string<CharT> string_type;
   typedef basic_option_description<CharT> description_type;
 
-  string_type out;
-
-  typedef std::pair<const description_type *,string_type> output_pair_type;
-  std::vector<output_pair_type> output_grp;
-  output_grp.reserve(grp.size());
+  std::vector<const description_type *> entries;
+  entries.reserve(grp.size());
 
   for(auto &desc : grp) {
     // hidden means no long or short key descriptions
-    if((desc.key_description)) {
-      output_grp.emplace_back(
-        std::make_pair(&desc,fmt.typeset_description(desc)));
-    }
+    if((desc.key_description))
+      entries.push_back(&desc);
+  }
+
+  // Sort the results if requested preferring precomputed keys
+  auto &&sort_key = fmt.sort_key();
+  if(sort_key) {
+    typedef std::pair<std::basic_string<CharT>,const description_type *>
+      keyed_entry_type;
+
+    std::vector<keyed_entry_type> keyed;
+    keyed.reserve(entries.size());
+    for(auto &desc : entries)
+      keyed.emplace_back(sort_key(*desc),desc);
+
+    std::stable_sort(keyed.begin(),keyed.end(),
+      [](const keyed_entry_type &lhs, const keyed_entry_type &rhs) {
+        return lhs.first < rhs.first;
+      });
+
+    for(std::size_t i=0; i<keyed.size(); ++i)
+      entries[i] = keyed[i].second;
+
+    return entries;
   }
 
-  // Sort the results if requested
   auto &&compare = fmt.compare();
   if(compare) {
-    std::sort(output_grp.begin(),output_grp.end(),
-      [&](const output_pair_type &lhs, const output_pair_type &rhs) {
-        return compare(*lhs.first,*rhs.first);
+    std::stable_sort(entries.begin(),entries.end(),
+      [&](const description_type *lhs, const description_type *rhs) {
+        return compare(*lhs,*rhs);
       });
   }
 
-  for(auto &pair : output_grp) {
-    out.append(pair.second);
+  return entries;
+}
+
+}
+
+template<typename CharT>
+std::basic_string<CharT>
+to_string(const std::vector<basic_option_description<CharT> > &grp,
+  const basic_description_formatter<CharT> &fmt =
+    basic_default_formatter<CharT>())
+{
+  std::basic_string<CharT> out;
+
+  for(auto &desc : detail::help_entries(grp,fmt)) {
+    fmt.write_description(out,*desc);
     out.push_back('\n');
   }
 
   return out;
 }
 
+/*
+  Write the help text for grp to os one entry at a time. This produces the
+  same output as `to_string(grp,fmt)` but only holds one formatted entry in
+  memory at a time.
+*/
+template<typename CharT, typename Traits>
+std::basic_ostream<CharT,Traits> &
+write_help(std::basic_ostream<CharT,Traits> &os,
+  const std::vector<basic_option_description<CharT> > &grp,
+  const basic_description_formatter<CharT> &fmt =
+    basic_default_formatter<CharT>())
+{
+  std::basic_string<CharT> entry;
+
+  for(auto &desc : detail::help_entries(grp,fmt)) {
+    entry.clear();
+    fmt.write_description(entry,*desc);
+    entry.push_back('\n');
+
+    if(!os.write(entry.data(),entry.size()))
+      break;
+  }
+
+  return os;
+}
+
 
 }
 
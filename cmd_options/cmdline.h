@@ -0,0 +1,219 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_CMDLINE_H
+#define CMD_OPTIONS_CMDLINE_H
+
+#include "cmd_options.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace cmd_options {
+
+/*
+  An argument range over a buffer of NUL separated arguments such as the
+  contents of `/proc/<pid>/cmdline`.
+
+  The iterators yield `const char *` pointing directly into the buffer so
+  the range can be given to `parse_arguments` or
+  `parse_incremental_arguments` without first splitting the buffer into
+  strings. If the last argument in the buffer is not terminated it is the
+  only one that is copied. For example:
+
+    auto args = cmdline_arguments::from_process(pid);
+    std::tie(res,vm) = cmd_options::parse_arguments(
+      std::next(args.begin()),args.end(),grp);
+
+  where the first argument is skipped as it is the program name. The
+  buffer, and this object or the object it was moved to, must outlive any
+  iterators into it including those kept by lazy operands in the variable
+  map. Iterators refer to the arguments rather than to this object so
+  they remain valid when it is moved. A moved from object is empty.
+*/
+class cmdline_arguments {
+  private:
+    struct range_type {
+      const char *first;
+      const char *last;
+
+      // start of the unterminated last argument, if any, and its copy
+      const char *tail_begin;
+      std::string tail;
+
+      std::shared_ptr<std::vector<char> > buffer;
+    };
+
+  public:
+    class const_iterator {
+      public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef const char * value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type * pointer;
+        typedef value_type reference;
+
+        const_iterator(void) :_cur(nullptr), _range(nullptr) {}
+
+        reference operator*(void) const {
+          return (_cur == _range->tail_begin ? _range->tail.c_str() : _cur);
+        }
+
+        const_iterator & operator++(void) {
+          if(_cur == _range->tail_begin)
+            _cur = _range->last;
+          else {
+            _cur = static_cast<const char *>(
+              std::memchr(_cur,'\0',static_cast<std::size_t>(
+                _range->last-_cur)))+1;
+          }
+          return *this;
+        }
+
+        const_iterator operator++(int) {
+          const_iterator result = *this;
+          ++(*this);
+          return result;
+        }
+
+        const_iterator & operator--(void) {
+          if(_cur == _range->last && _range->tail_begin)
+            _cur = _range->tail_begin;
+          else {
+            // skip the terminator of the previous argument
+            --_cur;
+            while(_cur != _range->first && *(_cur-1) != '\0')
+              --_cur;
+          }
+          return *this;
+        }
+
+        const_iterator operator--(int) {
+          const_iterator result = *this;
+          --(*this);
+          return result;
+        }
+
+        bool operator==(const const_iterator &rhs) const {
+          return _cur == rhs._cur;
+        }
+
+        bool operator!=(const const_iterator &rhs) const {
+          return _cur != rhs._cur;
+        }
+
+      private:
+        friend class cmdline_arguments;
+
+        const_iterator(const char *cur, const range_type *range)
+          :_cur(cur), _range(range) {}
+
+        const char *_cur;
+        const range_type *_range;
+    };
+
+    /*
+      Refer to the arguments in [first,last)
+    */
+    cmdline_arguments(const char *first, const char *last)
+      :_range(new range_type())
+    {
+      assign(first,last);
+    }
+
+    cmdline_arguments(cmdline_arguments &&) = default;
+    cmdline_arguments & operator=(cmdline_arguments &&) = default;
+
+    /*
+      Read the arguments of process \c pid from `/proc/<pid>/cmdline`
+    */
+    static cmdline_arguments from_process(long pid) {
+      return from_file("/proc/"+std::to_string(pid)+"/cmdline");
+    }
+
+    /*
+      Read the arguments of this process from `/proc/self/cmdline`
+    */
+    static cmdline_arguments from_self(void) {
+      return from_file("/proc/self/cmdline");
+    }
+
+    /*
+      Read NUL separated arguments from \c filename. Files in /proc
+      report a size of zero so the file is read to its end.
+    */
+    static cmdline_arguments from_file(const std::string &filename) {
+      std::ifstream in(filename.c_str(),std::ios::binary);
+      if(!in)
+        throw std::runtime_error("unable to open "+filename);
+
+      std::shared_ptr<std::vector<char> > buffer =
+        std::make_shared<std::vector<char> >(
+          std::istreambuf_iterator<char>(in),std::istreambuf_iterator<char>());
+
+      cmdline_arguments result(buffer->data(),buffer->data()+buffer->size());
+      result._range->buffer = buffer;
+
+      return result;
+    }
+
+    const_iterator begin(void) const {
+      return (_range ? const_iterator(_range->first,_range.get()) :
+        const_iterator());
+    }
+
+    const_iterator end(void) const {
+      return (_range ? const_iterator(_range->last,_range.get()) :
+        const_iterator());
+    }
+
+    bool empty(void) const {
+      return (!_range || _range->first == _range->last);
+    }
+
+  private:
+    // held apart from this object so that iterators survive a move
+    std::unique_ptr<range_type> _range;
+
+    void assign(const char *first, const char *last) {
+      _range->first = first;
+      _range->last = last;
+      _range->tail_begin = nullptr;
+
+      if(first != last && *(last-1) != '\0') {
+        const char *tail_begin = last;
+        while(tail_begin != first && *(tail_begin-1) != '\0')
+          --tail_begin;
+        _range->tail_begin = tail_begin;
+        _range->tail.assign(tail_begin,last);
+      }
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,328 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_CONFIG_FILE_H
+#define CMD_OPTIONS_CONFIG_FILE_H
+
+#include "cmd_options.h"
+
+#include <istream>
+#include <fstream>
+
+namespace cmd_options {
+
+/*
+  Thrown when an entry of a configuration file cannot be handled. The
+  exception thrown by the option description is nested within. If the
+  file could not be read, \c line() is zero.
+*/
+class config_file_error : public std::runtime_error {
+  public:
+    config_file_error(const std::string &filename, std::size_t line)
+      :std::runtime_error("config_file_error"), _filename(filename),
+        _line(line) {}
+
+    const char * filename(void) const noexcept {
+      return _filename.what();
+    }
+
+    std::size_t line(void) const noexcept {
+      return _line;
+    }
+
+  private:
+    std::runtime_error _filename;
+    std::size_t _line;
+};
+
+namespace detail {
+
+enum config_line_type {
+  config_blank,
+  config_section,
+  config_flag,
+  config_value
+};
+
+/*
+  Tokenize one line of a configuration file. A section line replaces \c
+  section. An entry line sets \c option to the option as it would be
+  given on the command line and \c value to the unquoted value if there
+  is one.
+*/
+template<typename CharT>
+config_line_type
+read_config_line(const std::basic_string<CharT> &line,
+  std::basic_string<CharT> &section, std::basic_string<CharT> &option,
+  std::basic_string<CharT> &value)
+{
+  typedef typename std::basic_string<CharT>::const_iterator iterator;
+
+  auto trim = [](iterator &first, iterator &last) {
+    while(first != last && is_C_space(*first))
+      ++first;
+    while(first != last && is_C_space(*(last-1)))
+      --last;
+  };
+
+  auto first = line.cbegin();
+  auto last = line.cend();
+  trim(first,last);
+
+  if(first == last || *first == '#' || *first == ';')
+    return config_blank;
+
+  if(*first == '[') {
+    if(last-first < 2 || *(last-1) != ']')
+      throw std::runtime_error("invalid section");
+
+    ++first;
+    --last;
+    trim(first,last);
+    section.assign(first,last);
+    return config_section;
+  }
+
+  auto assign = std::find(first,last,CharT('='));
+  bool value_provided = (assign != last);
+
+  auto key_last = assign;
+  trim(first,key_last);
+  if(first == key_last)
+    throw std::runtime_error("missing key");
+
+  // form the option as it would be given on the command line
+  std::size_t key_size = static_cast<std::size_t>(key_last-first);
+  if(!section.empty())
+    key_size += section.size()+1;
+
+  option.assign((key_size == 1 ? 1 : 2),CharT('-'));
+  if(!section.empty()) {
+    option.append(section);
+    option.push_back('.');
+  }
+  option.append(first,key_last);
+
+  if(!value_provided)
+    return config_flag;
+
+  auto value_first = assign+1;
+  trim(value_first,last);
+  if(last-value_first >= 2 && *value_first == '"' && *(last-1) == '"') {
+    ++value_first;
+    --last;
+  }
+  value.assign(value_first,last);
+
+  return config_value;
+}
+
+/*
+  The result of handling one configuration entry
+*/
+template<typename CharT>
+struct config_entry {
+  const basic_option_description<CharT> *desc;
+  parse_flag handles_arg;
+  std::basic_string<CharT> mapped_key;
+  any value;
+};
+
+/*
+  Find the description in \c option_descs that handles \c option and use
+  it to make the value of the entry. \c entry_count is given as both the
+  position and argument number.
+*/
+template<typename CharT>
+config_entry<CharT>
+make_config_entry(
+  const std::vector<const basic_option_description<CharT> *> &option_descs,
+  const std::basic_string<CharT> &option, bool value_provided,
+  const std::basic_string<CharT> &value, std::size_t entry_count,
+  const basic_variable_map<CharT> &vm)
+{
+  config_entry<CharT> entry{nullptr,parse_flag::reject,{},{}};
+
+  for(auto &cur : option_descs) {
+    basic_option_pack<CharT> option_pack = cur->unpack_option(option);
+    if(!option_pack.did_unpack)
+      continue;
+
+    if(cur->mapped_key) {
+      std::tie(entry.handles_arg,entry.mapped_key) =
+        cur->mapped_key(option_pack.raw_key,entry_count,entry_count,vm);
+    }
+    else {
+      entry.handles_arg = parse_flag::accept;
+      entry.mapped_key = option_pack.raw_key;
+    }
+
+    if(entry.handles_arg) {
+      entry.desc = cur;
+      break;
+    }
+  }
+
+  if(!entry.desc)
+    throw unknown_option_error(entry_count,entry_count);
+
+  if(value_provided) {
+    if(!entry.desc->make_value)
+      throw unexpected_argument_error(entry_count,entry_count);
+
+    entry.value = entry.desc->make_value(entry.mapped_key,entry_count,
+      entry_count,value,vm);
+  }
+  else if(entry.desc->make_implicit_value)
+    entry.value = entry.desc->make_implicit_value(entry.mapped_key,vm);
+  else if(entry.desc->make_value)
+    throw missing_argument_error(entry_count,entry_count);
+
+  return entry;
+}
+
+template<typename CharT>
+std::vector<const basic_option_description<CharT> *>
+config_option_descriptions(const basic_options_group<CharT> &grp)
+{
+  std::vector<const basic_option_description<CharT> *> option_descs;
+  for(auto &desc : grp) {
+    if(desc.unpack_option)
+      option_descs.push_back(&desc);
+  }
+
+  return option_descs;
+}
+
+}
+
+/*
+  Parse configuration entries from \c in according to the options in \c
+  grp and return a copy of \c vm with the results added.
+
+  Each line of the input is one of:
+
+    # comment
+    ; comment
+    [section]
+    key = value
+    key
+
+  Whitespace around keys, values, and section names is ignored and a
+  value may be surrounded by double quotes to keep it. Entries following
+  `[section]` are given as `section.key`. An empty section name `[]`
+  returns to the top level.
+
+  Each entry is handled as the option `--key` (or `-k` for single
+  character keys) would be on the command line so that the option
+  descriptions in \c grp unpack, map, convert, and validate it. An entry
+  with a value is given that value, otherwise it is handled as an option
+  given without a value. Operands are not accepted. Once all entries are
+  read, the finalize function of each description is called so that
+  constraints apply to the combined result.
+
+  Input is read one line at a time into a reused buffer so that memory
+  use does not depend on the size of the input. Errors while handling an
+  entry are thrown as config_file_error for \c filename and the line
+  number with the original exception nested within.
+*/
+template<typename CharT, typename Traits>
+basic_variable_map<CharT>
+parse_config(std::basic_istream<CharT,Traits> &in,
+  const basic_options_group<CharT> &grp,
+  const basic_variable_map<CharT> &vm = basic_variable_map<CharT>(),
+  const std::string &filename = std::string())
+{
+  typedef std::basic_string<CharT> string_type;
+
+  basic_variable_map<CharT> _vm = vm;
+
+  auto &&option_descs = detail::config_option_descriptions(grp);
+
+  string_type line;
+  string_type section;
+  string_type option;
+  string_type value;
+  std::size_t line_num = 0;
+  std::size_t entry_count = 0;
+
+  while(std::getline(in,line)) {
+    ++line_num;
+
+    try {
+      detail::config_line_type type =
+        detail::read_config_line(line,section,option,value);
+
+      if(type == detail::config_blank || type == detail::config_section)
+        continue;
+
+      detail::config_entry<CharT> entry =
+        detail::make_config_entry(option_descs,option,
+          type == detail::config_value,value,entry_count,_vm);
+
+      if(!(entry.handles_arg & parse_flag::ignore))
+        _vm.emplace(std::move(entry.mapped_key),std::move(entry.value));
+
+      ++entry_count;
+    }
+    catch(...) {
+      std::throw_with_nested(config_file_error(filename,line_num));
+    }
+  }
+
+  if(in.bad())
+    throw config_file_error(filename,0);
+
+  for(auto &desc : grp) {
+    if(desc.finalize)
+      desc.finalize(_vm);
+  }
+
+  return _vm;
+}
+
+/*
+  Parse the configuration file \c filename. See parse_config.
+*/
+template<typename CharT>
+basic_variable_map<CharT>
+parse_config_file(const std::string &filename,
+  const basic_options_group<CharT> &grp,
+  const basic_variable_map<CharT> &vm = basic_variable_map<CharT>())
+{
+  std::basic_ifstream<CharT> in(filename.c_str());
+  if(!in)
+    throw config_file_error(filename,0);
+
+  detail::observe_file(filename);
+
+  return parse_config(in,grp,vm,filename);
+}
+
+}
+
+#endif
@@ -0,0 +1,396 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_CONFIG_RELOAD_H
+#define CMD_OPTIONS_CONFIG_RELOAD_H
+
+#include "cmd_options.h"
+#include "cmd_options/config_file.h"
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <tuple>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#define CMD_OPTIONS_HAVE_INOTIFY 1
+#endif
+
+namespace cmd_options {
+
+/*
+  A configuration file that can be reloaded while the program runs.
+
+  The file is parsed as parse_config_file would on construction. Each
+  call to reload() reads it again and returns the keys that were added,
+  removed, or changed since the last successful load. Entries whose
+  option and value text did not change keep the value made for them
+  previously so that their conversions and basic_value callbacks are not
+  run again. This assumes the descriptions in \c grp do not depend on
+  the order of or values of other entries. After the first load, only the
+  finalize functions of descriptions that map an added, removed, or
+  changed key are called, along with those of descriptions whose
+  constraints made by set_default_constraints name such a key. Any other
+  finalize function is assumed to only check its own key. If the reload
+  fails, the previous variables are kept and the error is thrown as it
+  would be by parse_config.
+
+  On Linux, watch() starts watching the file with inotify so that
+  update() only reloads when the file was written, replaced, or created.
+  The descriptor given by fd() can be waited on with poll or select. The
+  directory containing the file is watched so that editors that replace
+  the file are noticed.
+
+  \c grp must outlive this object.
+*/
+template<typename CharT>
+class basic_config_reloader {
+  public:
+    typedef std::basic_string<CharT> string_type;
+    typedef basic_options_group<CharT> options_group_type;
+    typedef basic_variable_map<CharT> variable_map_type;
+    typedef basic_variable_map_diff<CharT> diff_type;
+
+    basic_config_reloader(const std::string &filename,
+      const options_group_type &grp)
+        :_filename(filename), _grp(grp),
+          _option_descs(detail::config_option_descriptions(grp)), _fd(-1)
+    {
+      reload();
+    }
+
+    basic_config_reloader(const basic_config_reloader &) = delete;
+    basic_config_reloader & operator=(const basic_config_reloader &) = delete;
+
+    ~basic_config_reloader(void) {
+#ifdef CMD_OPTIONS_HAVE_INOTIFY
+      if(_fd != -1)
+        close(_fd);
+#endif
+    }
+
+    const variable_map_type & variables(void) const {
+      return _vm;
+    }
+
+    const std::string & filename(void) const {
+      return _filename;
+    }
+
+    /*
+      Read the file again and return what changed
+    */
+    diff_type reload(void);
+
+    /*
+      Start watching the file for changes. Throws std::system_error if
+      the watch cannot be created or inotify is not available.
+    */
+    void watch(void);
+
+    /*
+      The inotify descriptor or -1 if not watching
+    */
+    int fd(void) const {
+      return _fd;
+    }
+
+    /*
+      True if the watched file changed since the last call. Reads all
+      pending events without blocking. If not watching, this is always
+      true.
+    */
+    bool pending(void);
+
+    /*
+      reload() if pending()
+    */
+    diff_type update(void) {
+      return (pending() ? reload() : diff_type());
+    }
+
+  private:
+    struct entry_record {
+      string_type option;
+      bool value_provided;
+      string_type value;
+      detail::config_entry<CharT> entry;
+
+      std::tuple<const string_type &,bool,const string_type &>
+      source(void) const {
+        return std::tie(option,value_provided,value);
+      }
+    };
+
+    typedef std::map<string_type,std::vector<const entry_record *> >
+      key_index_type;
+
+    std::string _filename;
+    const options_group_type &_grp;
+    std::vector<const basic_option_description<CharT> *> _option_descs;
+    std::vector<entry_record> _entries;
+    variable_map_type _vm;
+    bool _loaded = false;
+    int _fd;
+
+    static key_index_type key_index(const std::vector<entry_record> &entries)
+    {
+      key_index_type index;
+      for(auto &rec : entries) {
+        if(!(rec.entry.handles_arg & parse_flag::ignore))
+          index[rec.entry.mapped_key].push_back(&rec);
+      }
+
+      return index;
+    }
+
+    /*
+      True if the constraints of desc name any of the keys in diff
+    */
+    static bool names_any(const basic_option_description<CharT> &desc,
+      const diff_type &diff)
+    {
+      const detail::constraint_check<CharT> *check =
+        desc.finalize.template target<detail::constraint_check<CharT> >();
+      if(!check)
+        return false;
+
+      for(auto *keys : {&diff.added,&diff.removed,&diff.changed}) {
+        for(auto &key : *keys) {
+          if(check->names(key))
+            return true;
+        }
+      }
+
+      return false;
+    }
+
+    static bool same_source(const std::vector<const entry_record *> &lhs,
+      const std::vector<const entry_record *> &rhs)
+    {
+      if(lhs.size() != rhs.size())
+        return false;
+
+      for(std::size_t i=0; i<lhs.size(); ++i) {
+        if(lhs[i]->source() != rhs[i]->source())
+          return false;
+      }
+
+      return true;
+    }
+};
+
+template<typename CharT>
+typename basic_config_reloader<CharT>::diff_type
+basic_config_reloader<CharT>::reload(void)
+{
+  typedef std::tuple<const string_type &,bool,const string_type &> source_type;
+
+  std::basic_ifstream<CharT> in(_filename.c_str());
+  if(!in)
+    throw config_file_error(_filename,0);
+
+  // previous entries by source text, each reused at most once
+  std::multimap<source_type,const entry_record *> previous;
+  for(auto &rec : _entries)
+    previous.emplace(rec.source(),&rec);
+
+  std::vector<entry_record> entries;
+  variable_map_type vm;
+
+  string_type line;
+  string_type section;
+  entry_record rec;
+  std::size_t line_num = 0;
+
+  while(std::getline(in,line)) {
+    ++line_num;
+
+    try {
+      detail::config_line_type type =
+        detail::read_config_line(line,section,rec.option,rec.value);
+
+      if(type == detail::config_blank || type == detail::config_section)
+        continue;
+
+      rec.value_provided = (type == detail::config_value);
+      if(!rec.value_provided)
+        rec.value.clear();
+
+      auto loc = previous.find(rec.source());
+      if(loc != previous.end()) {
+        // copied so that the previous state is kept if the reload fails
+        rec.entry = loc->second->entry;
+        previous.erase(loc);
+      }
+      else {
+        rec.entry = detail::make_config_entry(_option_descs,rec.option,
+          rec.value_provided,rec.value,entries.size(),vm);
+      }
+
+      if(!(rec.entry.handles_arg & parse_flag::ignore))
+        vm.emplace(rec.entry.mapped_key,rec.entry.value);
+
+      entries.push_back(std::move(rec));
+    }
+    catch(...) {
+      std::throw_with_nested(config_file_error(_filename,line_num));
+    }
+  }
+
+  if(in.bad())
+    throw config_file_error(_filename,0);
+
+  // merge walk the keys of the previous and new entries
+  diff_type diff;
+  std::vector<const basic_option_description<CharT> *> touched;
+
+  key_index_type old_index = key_index(_entries);
+  key_index_type new_index = key_index(entries);
+
+  auto old_cur = old_index.begin();
+  auto new_cur = new_index.begin();
+  while(old_cur != old_index.end() || new_cur != new_index.end()) {
+    if(new_cur == new_index.end() ||
+      (old_cur != old_index.end() && old_cur->first < new_cur->first))
+    {
+      diff.removed.push_back(old_cur->first);
+      touched.push_back(old_cur->second.front()->entry.desc);
+      ++old_cur;
+    }
+    else if(old_cur == old_index.end() || new_cur->first < old_cur->first) {
+      diff.added.push_back(new_cur->first);
+      touched.push_back(new_cur->second.front()->entry.desc);
+      ++new_cur;
+    }
+    else {
+      if(!same_source(old_cur->second,new_cur->second)) {
+        diff.changed.push_back(new_cur->first);
+        touched.push_back(new_cur->second.front()->entry.desc);
+      }
+      ++old_cur;
+      ++new_cur;
+    }
+  }
+
+  std::sort(touched.begin(),touched.end());
+
+  for(auto &desc : _grp) {
+    if(!desc.finalize)
+      continue;
+
+    if(!_loaded ||
+      std::binary_search(touched.begin(),touched.end(),&desc) ||
+      names_any(desc,diff))
+    {
+      desc.finalize(vm);
+    }
+  }
+
+  _entries.swap(entries);
+  _vm.swap(vm);
+  _loaded = true;
+
+  return diff;
+}
+
+template<typename CharT>
+void basic_config_reloader<CharT>::watch(void)
+{
+#ifdef CMD_OPTIONS_HAVE_INOTIFY
+  if(_fd != -1)
+    return;
+
+  std::string::size_type slash = _filename.rfind('/');
+  std::string dir = (slash == std::string::npos ? std::string(".") :
+    (slash == 0 ? std::string("/") : _filename.substr(0,slash)));
+
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(fd == -1)
+    throw std::system_error(errno,std::generic_category(),_filename);
+
+  if(inotify_add_watch(fd,dir.c_str(),
+    IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) == -1)
+  {
+    int err = errno;
+    close(fd);
+    throw std::system_error(err,std::generic_category(),_filename);
+  }
+
+  _fd = fd;
+#else
+  throw std::system_error(std::make_error_code(std::errc::not_supported));
+#endif
+}
+
+template<typename CharT>
+bool basic_config_reloader<CharT>::pending(void)
+{
+#ifdef CMD_OPTIONS_HAVE_INOTIFY
+  if(_fd == -1)
+    return true;
+
+  std::string::size_type slash = _filename.rfind('/');
+  const char *name = _filename.c_str() +
+    (slash == std::string::npos ? 0 : slash+1);
+
+  alignas(struct inotify_event)
+    char buf[4096];
+
+  bool changed = false;
+  while(true) {
+    ssize_t len = read(_fd,buf,sizeof(buf));
+    if(len <= 0) {
+      if(len == -1 && errno == EINTR)
+        continue;
+      break;
+    }
+
+    for(char *cur = buf; cur < buf+len;) {
+      const struct inotify_event *event =
+        reinterpret_cast<const struct inotify_event *>(cur);
+      if(event->len && std::strcmp(event->name,name) == 0)
+        changed = true;
+
+      cur += sizeof(struct inotify_event)+event->len;
+    }
+  }
+
+  return changed;
+#else
+  return true;
+#endif
+}
+
+typedef basic_config_reloader<char> config_reloader;
+typedef basic_config_reloader<wchar_t> wconfig_reloader;
+
+}
+
+#endif
@@ -0,0 +1,274 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_ENVIRONMENT_H
+#define CMD_OPTIONS_ENVIRONMENT_H
+
+#include "cmd_options.h"
+
+#include <cstring>
+
+#if defined(__APPLE__)
+#include <crt_externs.h>
+#elif defined(_WIN32)
+#include <stdlib.h>
+#else
+// POSIX requires the application to declare environ itself
+extern char **environ;
+#endif
+
+namespace cmd_options {
+
+namespace detail {
+
+/*
+  The environment of the current process as a null terminated array of
+  `NAME=VALUE` strings. Shared libraries on macOS do not have access to
+  environ directly.
+*/
+inline const char * const * process_environment(void)
+{
+#if defined(__APPLE__)
+  return *_NSGetEnviron();
+#elif defined(_WIN32)
+  return _environ;
+#else
+  return environ;
+#endif
+}
+
+}
+
+/*
+  Thrown when an environment variable cannot be handled. The exception
+  thrown by the option description is nested within.
+*/
+class environment_error : public std::runtime_error {
+  public:
+    environment_error(const std::string &variable)
+      :std::runtime_error("environment_error"), _variable(variable) {}
+
+    const char * variable(void) const noexcept {
+      return _variable.what();
+    }
+
+  private:
+    std::runtime_error _variable;
+};
+
+/*
+  The default mapping from environment variable names to option names.
+  The prefix is already removed, the remainder is lower cased and
+  underscores become dashes. That is `APP_LOG_LEVEL` with prefix `APP_`
+  is the option `log-level`.
+*/
+inline std::string default_environment_name(const std::string &name)
+{
+  std::string result(name);
+  for(auto &c : result) {
+    if(c == '_')
+      c = '-';
+    else if(c >= 'A' && c <= 'Z')
+      c = static_cast<char>(c - 'A' + 'a');
+  }
+
+  return result;
+}
+
+/*
+  Read options from environment variables.
+
+  Variables starting with \c prefix are mapped to option names by the
+  name mapping (default_environment_name by default) and handled as the
+  option `--name` would be on the command line so that the option
+  descriptions of the group unpack, map, convert, and validate it. The
+  variable's value is given as the option's value and an empty value
+  gives the option's implicit value if it has one. Options that take no
+  value are set when the variable is empty or one of `1`, `true`, `yes`,
+  or `on`, are not set when it is one of `0`, `false`, `no`, or `off`,
+  and otherwise result in an unexpected_argument_error. Variables that
+  do not name an option, or that the mapping gives an empty name, are
+  ignored.
+
+  The environment is scanned once per call to parse. The description and
+  mapped key found for each name are kept in a lookup table so that
+  repeated parses, or variables naming the same option, do not search the
+  group again. As such, the mapped key of an option given in the
+  environment must not depend on its position or on the variable map.
+
+  Errors are rethrown as environment_error naming the variable with the
+  original exception nested within. The group must outlive this object.
+*/
+class environment_source {
+  public:
+    typedef std::function<std::string(const std::string &)> name_mapping_type;
+
+    environment_source(const options_group &grp, const std::string &prefix,
+      const name_mapping_type &name_mapping = default_environment_name)
+        :_grp(grp), _prefix(prefix), _name_mapping(name_mapping)
+    {
+      for(auto &desc : grp) {
+        if(desc.unpack_option)
+          _option_descs.push_back(&desc);
+      }
+    }
+
+    /*
+      Return a copy of \c vm with the options in \c env added. \c env is a
+      null terminated array of `NAME=VALUE` strings and defaults to the
+      environment of the current process.
+    */
+    variable_map parse(const variable_map &vm = variable_map(),
+      const char * const *env = detail::process_environment());
+
+  private:
+    struct entry_type {
+      const option_description *desc;
+      parse_flag handles_arg;
+      std::string mapped_key;
+    };
+
+    const options_group &_grp;
+    std::string _prefix;
+    name_mapping_type _name_mapping;
+    std::vector<const option_description *> _option_descs;
+
+    // option name to its handler or to null if there is none
+    std::unordered_map<std::string,std::unique_ptr<entry_type> > _lookup;
+
+    const entry_type * find(const std::string &name, const variable_map &vm);
+};
+
+inline const environment_source::entry_type *
+environment_source::find(const std::string &name, const variable_map &vm)
+{
+  auto loc = _lookup.find(name);
+  if(loc != _lookup.end())
+    return loc->second.get();
+
+  std::unique_ptr<entry_type> entry;
+
+  std::string option((name.size() == 1 ? "-" : "--"));
+  option.append(name);
+
+  for(auto &desc : _option_descs) {
+    auto &&option_pack = desc->unpack_option(option);
+    if(!option_pack.did_unpack)
+      continue;
+
+    parse_flag handles_arg = parse_flag::accept;
+    std::string mapped_key = option_pack.raw_key;
+    if(desc->mapped_key)
+      std::tie(handles_arg,mapped_key) =
+        desc->mapped_key(option_pack.raw_key,0,0,vm);
+
+    if(handles_arg) {
+      entry.reset(new entry_type{desc,handles_arg,std::move(mapped_key)});
+      break;
+    }
+  }
+
+  return (_lookup[name] = std::move(entry)).get();
+}
+
+inline variable_map environment_source::parse(const variable_map &vm,
+  const char * const *env)
+{
+  variable_map _vm = vm;
+
+  detail::observe_environment(_prefix,env);
+
+  std::size_t entry_count = 0;
+
+  for(; env && *env; ++env) {
+    const char *var = *env;
+    if(std::strncmp(var,_prefix.c_str(),_prefix.size()) != 0)
+      continue;
+
+    const char *assign = std::strchr(var,'=');
+    if(!assign)
+      continue;
+
+    std::string variable(var,assign);
+
+    try {
+      std::string name = _name_mapping(variable.substr(_prefix.size()));
+      if(name.empty())
+        continue;
+
+      const entry_type *entry = find(name,_vm);
+      if(!entry)
+        continue;
+
+      const option_description &desc = *(entry->desc);
+      std::string value(assign+1);
+
+      any val;
+      if(desc.make_value && value.empty() && desc.make_implicit_value)
+        val = desc.make_implicit_value(entry->mapped_key,_vm);
+      else if(desc.make_value) {
+        val = desc.make_value(entry->mapped_key,entry_count,entry_count,value,
+          _vm);
+      }
+      else {
+        if(value == "0" || value == "false" || value == "no" ||
+          value == "off")
+        {
+          continue;
+        }
+
+        if(!(value.empty() || value == "1" || value == "true" ||
+          value == "yes" || value == "on"))
+        {
+          throw unexpected_argument_error(entry_count,entry_count);
+        }
+
+        if(desc.make_implicit_value)
+          val = desc.make_implicit_value(entry->mapped_key,_vm);
+      }
+
+      if(!(entry->handles_arg & parse_flag::ignore))
+        _vm.emplace(entry->mapped_key,std::move(val));
+
+      ++entry_count;
+    }
+    catch(...) {
+      std::throw_with_nested(environment_error(variable));
+    }
+  }
+
+  for(auto &desc : _grp) {
+    if(desc.finalize)
+      desc.finalize(_vm);
+  }
+
+  return _vm;
+}
+
+}
+
+#endif
@@ -116,17 +116,16 @@ make_f_flag(const std::basic_string<CharT> &opt_spec,
     };
 
   if(negative_form) {
-    desc.key_description = [=](void) {
-      return string_type{'-','f','n','o','-'} + long_opt;
-    };
+    desc.key_description = co::detail::format_description<CharT>(
+      string_type{'-','f','n','o','-'} + long_opt);
   }
   else {
-    desc.key_description = [=](void) {
-      return string_type{'-','f'} + long_opt;
-    };
+    desc.key_description = co::detail::format_description<CharT>(
+      string_type{'-','f'} + long_opt);
   }
 
-  desc.extended_description = [=](void) { return ext_desc; };
+  desc.extended_description =
+    co::detail::format_description<CharT>(ext_desc);
   co::set_default_option_value(co::basic_value<T,CharT>(),desc);
   co::set_default_constraints(cnts,desc,mapped_key);
 
@@ -0,0 +1,384 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_FLAT_VARIABLE_MAP_H
+#define CMD_OPTIONS_FLAT_VARIABLE_MAP_H
+
+#include "cmd_options.h"
+#include "cmd_options/snapshot.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+namespace cmd_options {
+
+/*
+  An immutable variable map read in place from a snapshot (see
+  snapshot.h).
+
+  The snapshot is a single contiguous region holding offsets rather than
+  pointers, so it can live in shared memory or a mapped file and be read
+  by several processes. For example, a server can parse its
+  configuration once, place it in an anonymous shared mapping with
+  make_shared(), and then fork its workers. The workers read the same
+  physical pages. Unlike a basic_variable_map, reading the values does
+  not write to the pages through reference counts or allocator state, so
+  no pages are copied on write.
+
+  Values are indexed in key order and a key is found by binary search
+  over the keys in place. Values of the built-in types are read directly
+  from the snapshot without consulting the serializer registry. Values of
+  other types are recreated through the serializer registered for their
+  type. string_data() gives strings of CharT without copying them.
+
+  The region must be aligned to 8 bytes, which mappings always are, and
+  must outlive this object unless given an owner.
+*/
+template<typename CharT>
+class basic_flat_variable_map {
+  public:
+    typedef std::basic_string<CharT> string_type;
+    typedef basic_variable_map<CharT> variable_map_type;
+    typedef std::size_t size_type;
+
+    static const size_type npos = static_cast<size_type>(-1);
+
+    basic_flat_variable_map(void) :_data(nullptr), _size(0), _count(0) {}
+
+    /*
+      View the snapshot of \c size bytes at \c data. The snapshot is
+      checked once here. \c owner is kept for as long as this object or
+      any copy of it exists.
+    */
+    basic_flat_variable_map(const char *data, std::size_t size,
+      const std::shared_ptr<const void> &owner = nullptr);
+
+    /*
+      Map \c filename as written by save_snapshot shared and read only
+    */
+    static basic_flat_variable_map map_file(const std::string &filename);
+
+    /*
+      Place the snapshot of \c vm in a new anonymous shared mapping
+      that is inherited by forked processes
+    */
+    static basic_flat_variable_map make_shared(const variable_map_type &vm);
+
+    size_type size(void) const {
+      return _count;
+    }
+
+    bool empty(void) const {
+      return _count == 0;
+    }
+
+    /*
+      The snapshot in place
+    */
+    const char * data(void) const {
+      return _data;
+    }
+
+    /*
+      The indices [first,last) of the values of \c key
+    */
+    std::pair<size_type,size_type> equal_range(const string_type &key) const;
+
+    /*
+      The index of the first value of \c key or npos
+    */
+    size_type find(const string_type &key) const {
+      auto &&range = equal_range(key);
+      return (range.first == range.second ? npos : range.first);
+    }
+
+    size_type count(const string_type &key) const {
+      auto &&range = equal_range(key);
+      return range.second - range.first;
+    }
+
+    const CharT * key_data(size_type n) const {
+      return reinterpret_cast<const CharT *>(_data+entry(n).key_offset);
+    }
+
+    size_type key_size(size_type n) const {
+      return entry(n).key_length;
+    }
+
+    string_type key(size_type n) const {
+      return string_type(key_data(n),key_size(n));
+    }
+
+    std::uint32_t tag(size_type n) const {
+      return entry(n).tag;
+    }
+
+    bool is_empty(size_type n) const {
+      return entry(n).tag == snapshot_empty;
+    }
+
+    /*
+      The value at \c n as a T. Throws bad_any_cast if it is not a T.
+    */
+    template<typename T>
+    T value(size_type n) const;
+
+    /*
+      The characters of the string of CharT at \c n in place
+    */
+    const CharT * string_data(size_type n) const;
+
+    size_type string_size(size_type n) const {
+      string_data(n);
+      return static_cast<size_type>(entry(n).value_length/sizeof(CharT));
+    }
+
+    /*
+      The last value of \c key which must exist
+    */
+    template<typename T>
+    T assert_last_value(const string_type &key) const {
+      auto &&range = equal_range(key);
+      assert(range.first != range.second);
+
+      return value<T>(range.second-1);
+    }
+
+    /*
+      Copy into a basic_variable_map
+    */
+    variable_map_type to_variable_map(void) const {
+      if(!_data)
+        return variable_map_type();
+
+      return read_snapshot<CharT>(_data,_size);
+    }
+
+  private:
+    const char *_data;
+    std::size_t _size;
+    size_type _count;
+    std::shared_ptr<const void> _owner;
+
+    const detail::snapshot_entry & entry(size_type n) const {
+      assert(n < _count);
+      return reinterpret_cast<const detail::snapshot_entry *>(
+        _data+sizeof(detail::snapshot_header))[n];
+    }
+
+    int compare(size_type n, const string_type &key) const {
+      size_type len = key_size(n);
+      int result = std::char_traits<CharT>::compare(key_data(n),key.data(),
+        std::min(len,key.size()));
+
+      if(result)
+        return result;
+
+      return (len < key.size() ? -1 : (len > key.size() ? 1 : 0));
+    }
+
+    // built-in types
+    template<typename T>
+    T read_value(const detail::snapshot_entry &cur, std::true_type) const {
+      if(cur.tag != detail::snapshot_builtin_tag<T>::value)
+        throw bad_any_cast();
+
+      return read_builtin<T>(cur,
+        std::integral_constant<bool,std::is_trivially_copyable<T>::value>());
+    }
+
+    // user types are read through their serializer
+    template<typename T>
+    T read_value(const detail::snapshot_entry &cur, std::false_type) const {
+      detail::snapshot_registry::serializer_ptr ser =
+        detail::snapshot_registry::instance().find(typeid(T));
+      if(!ser || ser->tag != cur.tag)
+        throw bad_any_cast();
+
+      return any_cast<T>(ser->load(detail::snapshot_value(_data,cur),
+        static_cast<std::size_t>(cur.value_length)));
+    }
+
+    // arithmetic types
+    template<typename T>
+    T read_builtin(const detail::snapshot_entry &cur, std::true_type) const {
+      if(cur.value_length != sizeof(T))
+        throw snapshot_error(std::string(),"invalid value");
+
+      T result;
+      std::memcpy(&result,detail::snapshot_value(_data,cur),sizeof(T));
+      return result;
+    }
+
+    // strings
+    template<typename T>
+    T read_builtin(const detail::snapshot_entry &cur, std::false_type) const {
+      typedef typename T::value_type char_type;
+
+      if(cur.value_length % sizeof(char_type))
+        throw snapshot_error(std::string(),"invalid value");
+
+      return T(reinterpret_cast<const char_type *>(
+        detail::snapshot_value(_data,cur)),
+        static_cast<std::size_t>(cur.value_length/sizeof(char_type)));
+    }
+
+    static std::shared_ptr<const void>
+    mapping(void *addr, std::size_t size) {
+      return std::shared_ptr<const void>(addr,[=](const void *) {
+        ::munmap(addr,size);
+      });
+    }
+};
+
+template<typename CharT>
+const typename basic_flat_variable_map<CharT>::size_type
+  basic_flat_variable_map<CharT>::npos;
+
+template<typename CharT>
+basic_flat_variable_map<CharT>::basic_flat_variable_map(const char *data,
+  std::size_t size, const std::shared_ptr<const void> &owner)
+    :_data(data), _size(size), _count(0), _owner(owner)
+{
+  if(reinterpret_cast<std::uintptr_t>(data) % 8)
+    throw snapshot_error(std::string(),"unaligned snapshot");
+
+  detail::snapshot_header header =
+    detail::read_snapshot_header(data,size,sizeof(CharT),std::string());
+
+  for(std::size_t n=0; n<header.count; ++n) {
+    detail::snapshot_entry cur =
+      detail::read_snapshot_entry(data,size,n,sizeof(CharT),std::string());
+
+    if(cur.key_offset % alignof(CharT) ||
+      (cur.value_length > sizeof(cur.value) && cur.value % 8))
+    {
+      throw snapshot_error(std::string(),"unaligned snapshot entry");
+    }
+  }
+
+  _count = static_cast<size_type>(header.count);
+}
+
+template<typename CharT>
+basic_flat_variable_map<CharT>
+basic_flat_variable_map<CharT>::map_file(const std::string &filename)
+{
+  detail::mapped_snapshot file = detail::map_snapshot(filename);
+
+  try {
+    return basic_flat_variable_map(file.data,file.size,file.owner);
+  }
+  catch(...) {
+    std::throw_with_nested(snapshot_error(filename,"invalid snapshot"));
+  }
+}
+
+template<typename CharT>
+basic_flat_variable_map<CharT>
+basic_flat_variable_map<CharT>::make_shared(const variable_map_type &vm)
+{
+  std::string snap = make_snapshot(vm);
+
+  void *addr = ::mmap(nullptr,snap.size(),PROT_READ|PROT_WRITE,
+    MAP_SHARED|MAP_ANONYMOUS,-1,0);
+  if(addr == MAP_FAILED)
+    throw snapshot_error(std::string(),"cannot map snapshot");
+
+  std::shared_ptr<const void> owner = mapping(addr,snap.size());
+
+  std::memcpy(addr,snap.data(),snap.size());
+  ::mprotect(addr,snap.size(),PROT_READ);
+
+  return basic_flat_variable_map(static_cast<const char *>(addr),
+    snap.size(),owner);
+}
+
+template<typename CharT>
+std::pair<typename basic_flat_variable_map<CharT>::size_type,
+  typename basic_flat_variable_map<CharT>::size_type>
+basic_flat_variable_map<CharT>::equal_range(const string_type &key) const
+{
+  size_type first = 0;
+  size_type len = _count;
+  while(len) {
+    size_type half = len/2;
+    if(compare(first+half,key) < 0) {
+      first += half+1;
+      len -= half+1;
+    }
+    else
+      len = half;
+  }
+
+  size_type last = first;
+  len = _count-first;
+  while(len) {
+    size_type half = len/2;
+    if(compare(last+half,key) <= 0) {
+      last += half+1;
+      len -= half+1;
+    }
+    else
+      len = half;
+  }
+
+  return std::make_pair(first,last);
+}
+
+template<typename CharT>
+template<typename T>
+T basic_flat_variable_map<CharT>::value(size_type n) const
+{
+  return read_value<T>(entry(n),std::integral_constant<bool,
+    detail::snapshot_builtin_tag<T>::value != snapshot_empty>());
+}
+
+template<typename CharT>
+const CharT * basic_flat_variable_map<CharT>::string_data(size_type n) const
+{
+  const detail::snapshot_entry &cur = entry(n);
+  if(cur.tag != detail::snapshot_builtin_tag<string_type>::value)
+    throw bad_any_cast();
+
+  return reinterpret_cast<const CharT *>(detail::snapshot_value(_data,cur));
+}
+
+typedef basic_flat_variable_map<char> flat_variable_map;
+typedef basic_flat_variable_map<wchar_t> wflat_variable_map;
+typedef basic_flat_variable_map<char16_t> flat_variable_map16;
+typedef basic_flat_variable_map<char32_t> flat_variable_map32;
+
+}
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_HELP_CACHE_H
+#define CMD_OPTIONS_HELP_CACHE_H
+
+#include "cmd_options.h"
+
+#include <typeindex>
+
+namespace cmd_options {
+
+/*
+  Typeset help text that is kept between requests.
+
+  The help for a group is typeset once and reused until either the group
+  or the formatter settings change. The cache is keyed on the identity of
+  the group (its address, storage, and size) along with the formatter's
+  dynamic type and its indent, column widths, padding, maximum width, and
+  sort flag. Changing a description in place cannot be detected, call
+  invalidate() afterwards.
+
+  The help for one option or a subset of options can also be given without
+  typesetting the rest. An option is selected by one of its names without
+  the leading dashes. The name is offered to each description as it would
+  be given on the command line, `--name` or for single character names
+  also `-name`, through its \c unpack_option and \c mapped_key functions.
+  A description only maps names to keys, so an option is not selected by
+  a mapped key given in its option spec that is not also one of its
+  names. Operands cannot be selected individually. The entries found for
+  a name are kept until the help is typeset again.
+
+  As with the standard containers, a single cache should not be used from
+  multiple threads at once without synchronization.
+*/
+template<typename CharT>
+class basic_help_cache {
+  public:
+    typedef std::basic_string<CharT> string_type;
+    typedef basic_option_description<CharT> description_type;
+    typedef basic_options_group<CharT> options_group_type;
+    typedef basic_default_formatter<CharT> formatter_type;
+
+    /*
+      The full help text. Identical to `to_string(grp,fmt)`.
+    */
+    const string_type & to_string(const options_group_type &grp,
+      const formatter_type &fmt = formatter_type())
+    {
+      update(grp,fmt);
+      return _text;
+    }
+
+    /*
+      The help entries for the option named \c name or the empty string if
+      there are none.
+    */
+    string_type to_string(const options_group_type &grp,
+      const string_type &name, const formatter_type &fmt = formatter_type())
+    {
+      return to_string(grp,std::vector<string_type>{name},fmt);
+    }
+
+    /*
+      The help entries for each of \c names given in the same order as the
+      full help text. Names without entries are ignored.
+    */
+    string_type to_string(const options_group_type &grp,
+      const std::vector<string_type> &names,
+      const formatter_type &fmt = formatter_type())
+    {
+      update(grp,fmt);
+
+      std::vector<std::size_t> selected;
+      for(auto &name : names) {
+        const std::vector<std::size_t> &entries = find(name);
+        selected.insert(selected.end(),entries.begin(),entries.end());
+      }
+
+      std::sort(selected.begin(),selected.end());
+      selected.erase(std::unique(selected.begin(),selected.end()),
+        selected.end());
+
+      string_type result;
+      for(auto &n : selected) {
+        result.append(_text,_offsets[n],_offsets[n+1]-_offsets[n]);
+      }
+
+      return result;
+    }
+
+    /*
+      Discard the cached text so that the next request typesets the group
+      again.
+    */
+    void invalidate(void) {
+      _group = nullptr;
+    }
+
+  private:
+    typedef std::tuple<std::size_t,std::size_t,std::size_t,std::size_t,bool>
+      settings_type;
+
+    const options_group_type *_group = nullptr;
+    const description_type *_group_data = nullptr;
+    std::size_t _group_size = 0;
+    std::type_index _formatter_type = std::type_index(typeid(void));
+    settings_type _settings;
+
+    string_type _text;
+    std::vector<std::size_t> _offsets;
+    std::vector<const description_type *> _entries;
+    std::map<string_type,std::vector<std::size_t> > _index;
+
+    static settings_type settings(const formatter_type &fmt) {
+      return settings_type(fmt.key_column_indent(),fmt.key_column_width(),
+        fmt.column_pad(),fmt.max_width(),fmt.sort_entries());
+    }
+
+    void update(const options_group_type &grp, const formatter_type &fmt);
+
+    const std::vector<std::size_t> & find(const string_type &name);
+
+    static bool accepts(const description_type &desc,
+      const string_type &option);
+};
+
+typedef basic_help_cache<char> help_cache;
+typedef basic_help_cache<wchar_t> whelp_cache;
+typedef basic_help_cache<char16_t> help_cache16;
+typedef basic_help_cache<char32_t> help_cache32;
+
+template<typename CharT>
+void basic_help_cache<CharT>::update(const options_group_type &grp,
+  const formatter_type &fmt)
+{
+  if(_group == &grp && _group_data == grp.data() &&
+    _group_size == grp.size() &&
+    _formatter_type == std::type_index(typeid(fmt)) &&
+    _settings == settings(fmt))
+  {
+    return;
+  }
+
+  _group = nullptr;
+  _text.clear();
+  _offsets.clear();
+  _entries.clear();
+  _index.clear();
+
+  for(auto &desc : detail::help_entries(grp,fmt)) {
+    _offsets.push_back(_text.size());
+    _entries.push_back(desc);
+
+    fmt.write_description(_text,*desc);
+    _text.push_back('\n');
+  }
+  _offsets.push_back(_text.size());
+
+  _group = &grp;
+  _group_data = grp.data();
+  _group_size = grp.size();
+  _formatter_type = std::type_index(typeid(fmt));
+  _settings = settings(fmt);
+}
+
+/*
+  The entries, in help order, of the options that accept \c name given as
+  an option argument
+*/
+template<typename CharT>
+const std::vector<std::size_t> &
+basic_help_cache<CharT>::find(const string_type &name)
+{
+  auto loc = _index.find(name);
+  if(loc != _index.end())
+    return loc->second;
+
+  std::vector<std::size_t> &entries = _index[name];
+  if(name.empty())
+    return entries;
+
+  const string_type long_opt = string_type{'-','-'} + name;
+  const string_type short_opt = string_type{'-'} + name;
+
+  for(std::size_t n=0; n<_entries.size(); ++n) {
+    const description_type &desc = *_entries[n];
+    if(!desc.unpack_option || !desc.mapped_key)
+      continue;
+
+    if(accepts(desc,long_opt) ||
+      (name.size() == 1 && accepts(desc,short_opt)))
+      entries.push_back(n);
+  }
+
+  return entries;
+}
+
+/*
+  True if \c desc unpacks \c option to a raw key that its \c mapped_key
+  function accepts. Nothing is known about the remaining
+  arguments here so any error from either function is taken as a rejection.
+*/
+template<typename CharT>
+bool basic_help_cache<CharT>::accepts(const description_type &desc,
+  const string_type &option)
+{
+  basic_variable_map<CharT> empty_vm;
+
+  try {
+    auto &&pack = desc.unpack_option(option);
+    if(!pack.did_unpack)
+      return false;
+
+    auto &&result = desc.mapped_key(pack.raw_key,0,0,empty_vm);
+    return (result.first & parse_flag::accept);
+  }
+  catch(const std::exception &) {
+    return false;
+  }
+}
+
+}
+
+#endif
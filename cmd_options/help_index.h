@@ -0,0 +1,246 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_HELP_INDEX_H
+#define CMD_OPTIONS_HELP_INDEX_H
+
+#include "cmd_options.h"
+
+namespace cmd_options {
+
+/*
+  Search the help text of an options group by keyword.
+
+  The index is built once from the key, value, and expanded extended
+  descriptions of each visible entry in the group. Only the text of a key
+  description outside of its %? clauses is indexed so that the argument
+  suffix of the default key description, which repeats the value
+  description, does not count as a match on the key. Text is split into
+  terms at anything that is not an ASCII letter or digit; code units
+  outside of ASCII are kept as part of a term. ASCII letters are compared
+  without regard to case.
+
+  A query is split into terms the same way. An entry matches if every
+  query term is the start of some term in the entry so that `verb` finds
+  `--verbose`. Matches are ranked by where the query terms are found:
+  entries matching on their key come before those matching on their value
+  description, which come before those matching only on their extended
+  description. Entries of the same rank are given in group order.
+
+  Only the matching entries are typeset. The index keeps pointers to the
+  descriptions in the group so the group must outlive the index and must
+  not be changed while it is in use.
+*/
+template<typename CharT>
+class basic_help_index {
+  public:
+    typedef std::basic_string<CharT> string_type;
+    typedef basic_option_description<CharT> description_type;
+    typedef basic_options_group<CharT> options_group_type;
+
+    enum field_type {
+      key_field = 0,
+      value_field = 1,
+      extended_field = 2
+    };
+
+    explicit basic_help_index(const options_group_type &grp);
+
+    /*
+      The descriptions matching \c query in rank order. An empty query
+      matches nothing.
+    */
+    std::vector<const description_type *>
+      search(const string_type &query) const;
+
+    /*
+      The help text of the descriptions matching \c query in rank order
+    */
+    string_type to_string(const string_type &query,
+      const basic_description_formatter<CharT> &fmt =
+        basic_default_formatter<CharT>()) const
+    {
+      string_type out;
+
+      for(auto &desc : search(query)) {
+        fmt.write_description(out,*desc);
+        out.push_back('\n');
+      }
+
+      return out;
+    }
+
+  private:
+    struct posting_type {
+      std::size_t entry;
+      field_type field;
+    };
+
+    std::vector<const description_type *> _entries;
+    std::map<string_type,std::vector<posting_type> > _terms;
+
+    void add_terms(const string_type &text, std::size_t entry,
+      field_type field);
+
+    static bool is_term_char(CharT c) {
+      return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') ||
+        static_cast<typename std::make_unsigned<CharT>::type>(c) > 0x7F);
+    }
+
+    template<typename Fn>
+    static void for_each_term(const string_type &text, const Fn &fn);
+};
+
+typedef basic_help_index<char> help_index;
+typedef basic_help_index<wchar_t> whelp_index;
+typedef basic_help_index<char16_t> help_index16;
+typedef basic_help_index<char32_t> help_index32;
+
+template<typename CharT>
+basic_help_index<CharT>::basic_help_index(const options_group_type &grp)
+{
+  for(auto &desc : grp) {
+    // hidden means no long or short key descriptions
+    if(!desc.key_description)
+      continue;
+
+    std::size_t entry = _entries.size();
+    _entries.push_back(&desc);
+
+    // the key without its argument, which is given by %?V clauses
+    string_type text;
+    detail::description_program(desc.key_description)->fixed_text(text);
+    add_terms(text,entry,key_field);
+
+    if(desc.value_description)
+      add_terms(desc.value_description(),entry,value_field);
+
+    if(desc.extended_description) {
+      text.clear();
+      detail::expand(text,desc.extended_description,desc);
+      add_terms(text,entry,extended_field);
+    }
+  }
+}
+
+template<typename CharT>
+std::vector<const basic_option_description<CharT> *>
+basic_help_index<CharT>::search(const string_type &query) const
+{
+  // best field for each entry matching all terms so far
+  std::vector<int> rank;
+  bool first_term = true;
+
+  for_each_term(query,[&](const string_type &term) {
+    std::vector<int> term_rank(_entries.size(),-1);
+
+    for(auto cur = _terms.lower_bound(term); cur != _terms.end() &&
+      cur->first.compare(0,term.size(),term) == 0; ++cur)
+    {
+      for(auto &posting : cur->second) {
+        int &r = term_rank[posting.entry];
+        if(r < 0 || posting.field < r)
+          r = posting.field;
+      }
+    }
+
+    if(first_term) {
+      rank = std::move(term_rank);
+      first_term = false;
+      return;
+    }
+
+    for(std::size_t i=0; i<rank.size(); ++i) {
+      if(rank[i] < 0 || term_rank[i] < 0)
+        rank[i] = -1;
+      else
+        rank[i] = std::max(rank[i],term_rank[i]);
+    }
+  });
+
+  std::vector<std::pair<int,std::size_t> > matches;
+  for(std::size_t i=0; i<rank.size(); ++i) {
+    if(rank[i] >= 0)
+      matches.emplace_back(rank[i],i);
+  }
+  std::sort(matches.begin(),matches.end());
+
+  std::vector<const description_type *> result;
+  result.reserve(matches.size());
+  for(auto &match : matches)
+    result.push_back(_entries[match.second]);
+
+  return result;
+}
+
+template<typename CharT>
+void basic_help_index<CharT>::add_terms(const string_type &text,
+  std::size_t entry, field_type field)
+{
+  for_each_term(text,[&](const string_type &term) {
+    std::vector<posting_type> &postings = _terms[term];
+    if(!postings.empty() && postings.back().entry == entry) {
+      if(field < postings.back().field)
+        postings.back().field = field;
+    }
+    else
+      postings.push_back(posting_type{entry,field});
+  });
+}
+
+/*
+  Call fn with each term of text folded to lower case
+*/
+template<typename CharT>
+template<typename Fn>
+void basic_help_index<CharT>::for_each_term(const string_type &text,
+  const Fn &fn)
+{
+  string_type term;
+
+  auto cur = text.begin();
+  while(cur != text.end()) {
+    while(cur != text.end() && !is_term_char(*cur))
+      ++cur;
+
+    term.clear();
+    while(cur != text.end() && is_term_char(*cur)) {
+      CharT c = *cur++;
+      if(c >= 'A' && c <= 'Z')
+        c = static_cast<CharT>(c - 'A' + 'a');
+      term.push_back(c);
+    }
+
+    if(!term.empty())
+      fn(term);
+  }
+}
+
+}
+
+#endif
@@ -0,0 +1,189 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_HELP_LITERAL_H
+#define CMD_OPTIONS_HELP_LITERAL_H
+
+#include "cmd_options.h"
+
+#include <ostream>
+#include <cstdint>
+
+namespace cmd_options {
+
+namespace detail {
+
+template<typename CharT>
+struct literal_traits;
+
+template<>
+struct literal_traits<char> {
+  static const char * prefix(void) {return "";}
+  static const char * type_name(void) {return "char";}
+};
+
+template<>
+struct literal_traits<wchar_t> {
+  static const char * prefix(void) {return "L";}
+  static const char * type_name(void) {return "wchar_t";}
+};
+
+template<>
+struct literal_traits<char16_t> {
+  static const char * prefix(void) {return "u";}
+  static const char * type_name(void) {return "char16_t";}
+};
+
+template<>
+struct literal_traits<char32_t> {
+  static const char * prefix(void) {return "U";}
+  static const char * type_name(void) {return "char32_t";}
+};
+
+/*
+  Write code point \c c as it should appear in a C++ string literal.
+  Characters outside of the printable ASCII range are written as octal
+  escapes for narrow strings and universal character names otherwise.
+  Octal escapes are used rather than hex escapes because they are never
+  longer than three digits and so cannot run into the following
+  character.
+*/
+inline void write_literal_char(std::ostream &os, std::uint32_t c,
+  bool narrow, bool after_question)
+{
+  static const char digits[] = "0123456789ABCDEF";
+
+  if(c == '\n')
+    os << "\\n";
+  else if(c == '\t')
+    os << "\\t";
+  else if(c == '"' || c == '\\')
+    os << '\\' << static_cast<char>(c);
+  else if(c == '?' && after_question) // avoid trigraphs
+    os << "\\?";
+  else if(c >= 0x20 && c < 0x7F)
+    os << static_cast<char>(c);
+  else if(narrow || c < 0x20 || c == 0x7F) {
+    os << '\\' << digits[(c>>6)&0x7] << digits[(c>>3)&0x7] << digits[c&0x7];
+  }
+  else {
+    os << "\\U";
+    for(int shift=28; shift>=0; shift-=4)
+      os << digits[(c>>shift)&0xF];
+  }
+}
+
+}
+
+/*
+  Write the help text for \c grp as the definition of a string literal
+  named \c name so that it can be generated at build time and embedded
+  in the program rather than typeset on every request. For example, a
+  generator program containing
+
+    cmd_options::write_help_literal(std::cout,"help_text",grp);
+
+  writes
+
+    const char help_text[] =
+      "  --foo,-f                Foo description\n"
+      ...;
+
+  which can then be included where `to_string(grp)` would have been
+  called. Each line of help text is given as its own literal. The text is
+  typeset by \c fmt so the result is for that formatter's fixed width.
+  Programs that need other widths should continue to use to_string at
+  runtime. Wide text that is not a valid code point, such as an unpaired
+  UTF-16 surrogate, is written as U+FFFD so that the literal compiles.
+*/
+template<typename CharT>
+std::ostream & write_help_literal(std::ostream &os, const std::string &name,
+  const std::vector<basic_option_description<CharT> > &grp,
+  const basic_description_formatter<CharT> &fmt =
+    basic_default_formatter<CharT>())
+{
+  typedef detail::literal_traits<CharT> traits_type;
+
+  std::basic_string<CharT> text = to_string(grp,fmt);
+
+  os << "const " << traits_type::type_name() << " " << name << "[] =\n";
+
+  const bool narrow = (sizeof(CharT) == 1);
+  bool line_start = true;
+  bool after_question = false;
+
+  if(text.empty())
+    os << "  " << traits_type::prefix() << "\"\"";
+
+  for(auto cur = text.begin(); cur != text.end(); ++cur) {
+    std::uint32_t c = static_cast<typename std::make_unsigned<CharT>::type>(
+      *cur);
+
+    // UTF-16 surrogate pairs are given as a single code point
+    if(sizeof(CharT) == 2 && c >= 0xD800 && c < 0xDC00 &&
+      (cur+1) != text.end())
+    {
+      std::uint32_t low = static_cast<std::uint32_t>(*(cur+1));
+      if(low >= 0xDC00 && low < 0xE000) {
+        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+        ++cur;
+      }
+    }
+
+    // an unpaired surrogate or a value past the last code point cannot be
+    // written as a universal character name
+    if(!narrow && ((c >= 0xD800 && c < 0xE000) || c > 0x10FFFF))
+      c = 0xFFFD;
+
+    if(line_start) {
+      if(cur != text.begin())
+        os << '\n';
+      os << "  " << traits_type::prefix() << '"';
+      line_start = false;
+    }
+
+    detail::write_literal_char(os,c,narrow,after_question);
+    after_question = (c == '?');
+
+    if(c == '\n') {
+      os << '"';
+      line_start = true;
+      after_question = false;
+    }
+  }
+
+  if(!line_start)
+    os << '"';
+
+  os << ";\n";
+
+  return os;
+}
+
+}
+
+#endif
@@ -0,0 +1,224 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_LAYOUT_H
+#define CMD_OPTIONS_LAYOUT_H
+
+#include "cmd_options.h"
+
+#include <cstdlib>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace cmd_options {
+
+/*
+  The width of the terminal attached to standard output in columns. If
+  standard output is not a terminal, the COLUMNS environment variable is
+  used if set and otherwise \c fallback is returned.
+*/
+inline std::size_t terminal_width(std::size_t fallback = 80)
+{
+#if defined(TIOCGWINSZ)
+  struct winsize ws;
+  if(ioctl(STDOUT_FILENO,TIOCGWINSZ,&ws) == 0 && ws.ws_col > 0)
+    return ws.ws_col;
+#endif
+
+  const char *columns = std::getenv("COLUMNS");
+  if(columns) {
+    char *end = nullptr;
+    unsigned long width = std::strtoul(columns,&end,10);
+    if(end != columns && *end == '\0' && width > 0)
+      return static_cast<std::size_t>(width);
+  }
+
+  return fallback;
+}
+
+/*
+  Lay out the help text for a group to the width of the terminal.
+
+  The key column of every visible entry is expanded and measured once in
+  code points, as the formatter pads the key column in code points. The
+  measured widths are kept and reused for every following render until
+  the group changes or invalidate() is called. The group is identified as
+  in basic_help_cache.
+
+  On each render the key column width is picked from the measured widths
+  so that key_fraction() of the entries (default 0.9) fit in the key
+  column. The key column is limited to half of the total width so that
+  a few very long keys do not squeeze the descriptions. Entries with keys
+  that do not fit start their description on the next line as with the
+  default formatter. Descriptions are wrapped to the given width, only a
+  key wider than the width itself or a width that cannot hold the column
+  padding and a single character extends past it.
+
+  The other settings of the formatter given to the constructor, such as
+  the indent, column padding, and sorting, are kept.
+*/
+template<typename CharT>
+class basic_column_layout {
+  public:
+    typedef std::basic_string<CharT> string_type;
+    typedef basic_options_group<CharT> options_group_type;
+    typedef basic_default_formatter<CharT> formatter_type;
+
+    explicit basic_column_layout(const formatter_type &fmt = formatter_type())
+      :_fmt(fmt) {}
+
+    void key_fraction(double val) {
+      _key_fraction = val;
+    }
+
+    double key_fraction(void) const {
+      return _key_fraction;
+    }
+
+    /*
+      The formatter used to render \c grp at \c width columns
+    */
+    formatter_type formatter(const options_group_type &grp,
+      std::size_t width);
+
+    /*
+      The help text for \c grp laid out for the current terminal
+    */
+    string_type to_string(const options_group_type &grp) {
+      return to_string(grp,terminal_width());
+    }
+
+    /*
+      The help text for \c grp laid out for \c width columns
+    */
+    string_type to_string(const options_group_type &grp, std::size_t width) {
+      return cmd_options::to_string(grp,formatter(grp,width));
+    }
+
+    /*
+      Discard the measured widths so that the next render measures the
+      group again
+    */
+    void invalidate(void) {
+      _group = nullptr;
+    }
+
+  private:
+    formatter_type _fmt;
+    double _key_fraction = 0.9;
+
+    const options_group_type *_group = nullptr;
+    const basic_option_description<CharT> *_group_data = nullptr;
+    std::size_t _group_size = 0;
+
+    // sorted widths of the key column of each visible entry
+    std::vector<std::size_t> _key_widths;
+
+    void measure(const options_group_type &grp);
+};
+
+typedef basic_column_layout<char> column_layout;
+typedef basic_column_layout<wchar_t> wcolumn_layout;
+typedef basic_column_layout<char16_t> column_layout16;
+typedef basic_column_layout<char32_t> column_layout32;
+
+template<typename CharT>
+typename basic_column_layout<CharT>::formatter_type
+basic_column_layout<CharT>::formatter(const options_group_type &grp,
+  std::size_t width)
+{
+  measure(grp);
+
+  // leave some room for the description column on very narrow terminals
+  const std::size_t min_desc_width = 20;
+
+  std::size_t key_width = _fmt.key_column_indent();
+  if(!_key_widths.empty()) {
+    double fraction = std::min(std::max(_key_fraction,0.0),1.0);
+    std::size_t n = static_cast<std::size_t>(
+      fraction*static_cast<double>(_key_widths.size()-1)+0.5);
+    key_width = _key_widths[n];
+  }
+
+  const std::size_t pad = _fmt.column_pad();
+  std::size_t max_key_width = width/2;
+  if(width > pad+min_desc_width)
+    max_key_width = std::min(max_key_width,width-pad-min_desc_width);
+
+  key_width = std::min(key_width,max_key_width);
+
+  // the description column needs at least one character
+  if(width > pad)
+    key_width = std::min(key_width,width-pad-1);
+  else {
+    key_width = 0;
+    width = pad+1;
+  }
+
+  formatter_type fmt = _fmt;
+  fmt.key_column_width(key_width);
+  fmt.max_width(width);
+
+  return fmt;
+}
+
+template<typename CharT>
+void basic_column_layout<CharT>::measure(const options_group_type &grp)
+{
+  if(_group == &grp && _group_data == grp.data() &&
+    _group_size == grp.size())
+  {
+    return;
+  }
+
+  _key_widths.clear();
+
+  string_type key;
+
+  for(auto &desc : grp) {
+    if(!desc.key_description)
+      continue;
+
+    key.clear();
+    detail::expand(key,desc.key_description,desc);
+    _key_widths.push_back(_fmt.key_column_indent()+
+      detail::code_point_width<CharT>(key.begin(),key.end()));
+  }
+
+  std::sort(_key_widths.begin(),_key_widths.end());
+
+  _group = &grp;
+  _group_data = grp.data();
+  _group_size = grp.size();
+}
+
+}
+
+#endif
@@ -0,0 +1,324 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_PARALLEL_H
+#define CMD_OPTIONS_PARALLEL_H
+
+#include "cmd_options.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+namespace cmd_options {
+
+/*
+  A fixed size pool of worker threads used to run independent parsing
+  tasks concurrently. The calling thread participates in the work so a
+  pool of size `n` runs `n-1` worker threads. A pool of size 1 runs
+  everything on the calling thread.
+
+  Work is given as a count and a function of the index. Indices are handed
+  out one at a time from a shared counter so that long and short tasks are
+  balanced across threads. Only one `for_each_index` runs at a time;
+  concurrent callers are serialized.
+*/
+class thread_pool {
+  public:
+    static std::size_t default_concurrency(void) {
+      std::size_t nthreads = std::thread::hardware_concurrency();
+      return (nthreads ? nthreads : 1);
+    }
+
+    explicit thread_pool(std::size_t nthreads = default_concurrency())
+      :_job(nullptr), _generation(0), _active(0), _stop(false)
+    {
+      for(std::size_t i=1; i<nthreads; ++i)
+        _workers.emplace_back(&thread_pool::work,this);
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool & operator=(const thread_pool &) = delete;
+
+    ~thread_pool(void) {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+      }
+      _wake.notify_all();
+
+      for(auto &worker : _workers)
+        worker.join();
+    }
+
+    /*
+      The number of threads that participate in the work including the
+      calling thread
+    */
+    std::size_t size(void) const {
+      return _workers.size()+1;
+    }
+
+    /*
+      Call `fn(i)` for every `i` in [0,n) and return once all calls have
+      completed. If any call throws, the remaining indices are still
+      processed and the first exception caught is rethrown.
+    */
+    template<typename Fn>
+    void for_each_index(std::size_t n, const Fn &fn) {
+      std::lock_guard<std::mutex> run_lock(_run_mutex);
+
+      std::atomic<std::size_t> next(0);
+      std::mutex error_mutex;
+      std::exception_ptr error;
+
+      std::function<void(void)> job = [&](void) {
+        for(std::size_t i = next++; i<n; i = next++) {
+          try {
+            fn(i);
+          }
+          catch(...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if(!error)
+              error = std::current_exception();
+          }
+        }
+      };
+
+      if(!_workers.empty() && n > 1) {
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _job = &job;
+          _active = _workers.size();
+          ++_generation;
+        }
+        _wake.notify_all();
+
+        job();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock,[this](void) {return _active == 0;});
+        _job = nullptr;
+      }
+      else
+        job();
+
+      if(error)
+        std::rethrow_exception(error);
+    }
+
+  private:
+    void work(void) {
+      std::size_t seen = 0;
+
+      while(true) {
+        const std::function<void(void)> *job;
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _wake.wait(lock,[&](void) {
+            return _stop || _generation != seen;
+          });
+
+          if(_stop)
+            return;
+
+          seen = _generation;
+          job = _job;
+        }
+
+        (*job)();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(--_active == 0)
+          _done.notify_one();
+      }
+    }
+
+    std::vector<std::thread> _workers;
+    std::mutex _run_mutex;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void(void)> *_job;
+    std::size_t _generation;
+    std::size_t _active;
+    bool _stop;
+};
+
+
+
+/*
+  The result of parsing one argument sequence with `parse_batch`.
+
+  - `vm` is the variable map returned by `parse_arguments` if parsing
+    succeeded.
+  - `position` is the index in the argument sequence where parsing
+    stopped. This is the size of the sequence unless parsing was
+    terminated early via `parse_flag::terminate` in which case it is the
+    index of the terminating argument.
+  - `error` holds the exception thrown while parsing, if any. In that case
+    `vm` is empty and `position` is zero.
+*/
+template<typename CharT>
+struct basic_batch_result {
+  typedef basic_variable_map<CharT> variable_map_type;
+
+  variable_map_type vm;
+  std::size_t position;
+  std::exception_ptr error;
+
+  basic_batch_result(void) :position(0) {}
+
+  bool failed(void) const {
+    return static_cast<bool>(error);
+  }
+};
+
+typedef basic_batch_result<char> batch_result;
+typedef basic_batch_result<wchar_t> wbatch_result;
+typedef basic_batch_result<char16_t> batch_result16;
+typedef basic_batch_result<char32_t> batch_result32;
+
+/*
+  Parse each argument sequence in [first,last) against the same group
+  `grp` on the threads of `executor` and return the results in input
+  order. Each element of the range must be a sequence of arguments
+  (ie something that `std::begin` and `std::end` can be called on such
+  as `std::vector<const char *>` or `std::vector<std::string>`) that
+  would otherwise be given to `parse_arguments`.
+
+  Errors do not stop the batch. Any exception thrown while parsing an
+  element is stored in the corresponding result.
+
+  The group is shared by all threads and is never modified. The
+  callbacks in each description are called concurrently and must abide
+  by the thread-safety requirements given for `basic_option_description`.
+*/
+template<typename ForwardIterator, typename CharT>
+std::vector<basic_batch_result<CharT> >
+parse_batch(ForwardIterator first, ForwardIterator last,
+  const basic_options_group<CharT> &grp,
+  const std::basic_string<CharT> &end_of_options, thread_pool &executor)
+{
+  typedef basic_batch_result<CharT> result_type;
+
+  std::vector<ForwardIterator> items;
+  for(; first != last; ++first)
+    items.push_back(first);
+
+  std::vector<result_type> results(items.size());
+
+  executor.for_each_index(items.size(),[&](std::size_t i) {
+    auto &&args = *(items[i]);
+    result_type &result = results[i];
+
+    try {
+      auto &&parsed =
+        parse_arguments(std::begin(args),std::end(args),grp,
+          basic_variable_map<CharT>(),end_of_options);
+
+      result.position = std::distance(std::begin(args),parsed.first);
+      result.vm = std::move(parsed.second);
+    }
+    catch(...) {
+      result.error = std::current_exception();
+    }
+  });
+
+  return results;
+}
+
+template<typename ForwardIterator, typename CharT>
+inline std::vector<basic_batch_result<CharT> >
+parse_batch(ForwardIterator first, ForwardIterator last,
+  const basic_options_group<CharT> &grp, thread_pool &executor)
+{
+  return parse_batch(first,last,grp,std::basic_string<CharT>{'-','-'},
+    executor);
+}
+
+
+/*
+  Typeset the help text for `grp` on the threads of `executor`. This
+  gives the same result as `to_string(grp,fmt)`: the entries are sorted as
+  requested by `fmt` on the calling thread and then typeset in blocks of
+  consecutive entries, one buffer per block, which are joined in order.
+
+  `fmt` is shared by all threads and must be safe to call concurrently.
+  The default formatter is. The description callbacks must abide by the
+  thread-safety requirements given for `basic_option_description`.
+*/
+template<typename CharT>
+std::basic_string<CharT>
+to_string(const basic_options_group<CharT> &grp,
+  const basic_description_formatter<CharT> &fmt, thread_pool &executor)
+{
+  typedef std::basic_string<CharT> string_type;
+
+  auto &&entries = detail::help_entries(grp,fmt);
+
+  // a few blocks per thread balances uneven entries without giving each
+  // entry its own buffer
+  std::size_t nblocks = std::min(entries.size(),executor.size()*4);
+  std::vector<string_type> blocks(nblocks);
+
+  executor.for_each_index(nblocks,[&](std::size_t n) {
+    std::size_t first = entries.size()*n/nblocks;
+    std::size_t last = entries.size()*(n+1)/nblocks;
+
+    // each block is rendered on one thread into its own buffer
+    string_type &out = blocks[n];
+    for(std::size_t i=first; i<last; ++i) {
+      fmt.write_description(out,*(entries[i]));
+      out.push_back('\n');
+    }
+  });
+
+  std::size_t size = 0;
+  for(auto &block : blocks)
+    size += block.size();
+
+  string_type out;
+  out.reserve(size);
+  for(auto &block : blocks)
+    out.append(block);
+
+  return out;
+}
+
+template<typename CharT>
+inline std::basic_string<CharT>
+to_string(const basic_options_group<CharT> &grp, thread_pool &executor)
+{
+  return to_string(grp,basic_default_formatter<CharT>(),executor);
+}
+
+}
+
+#endif
@@ -0,0 +1,744 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_PARSE_CACHE_H
+#define CMD_OPTIONS_PARSE_CACHE_H
+
+#include "cmd_options.h"
+#include "cmd_options/environment.h"
+#include "cmd_options/snapshot.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+
+namespace cmd_options {
+
+namespace detail {
+
+/*
+  64 bit FNV-1a
+*/
+class fnv1a_hash {
+  public:
+    fnv1a_hash(void) :_hash(14695981039346656037ULL) {}
+
+    fnv1a_hash & add(const void *data, std::size_t size) {
+      const unsigned char *cur = static_cast<const unsigned char *>(data);
+      for(std::size_t i=0; i<size; ++i) {
+        _hash ^= cur[i];
+        _hash *= 1099511628211ULL;
+      }
+      return *this;
+    }
+
+    std::uint64_t value(void) const {
+      return _hash;
+    }
+
+  private:
+    std::uint64_t _hash;
+};
+
+inline std::int64_t modification_time(const struct stat &st)
+{
+#if defined(__APPLE__)
+  const struct timespec &mtime = st.st_mtimespec;
+#else
+  const struct timespec &mtime = st.st_mtim;
+#endif
+  return static_cast<std::int64_t>(mtime.tv_sec)*1000000000 + mtime.tv_nsec;
+}
+
+/*
+  The size and modification time of \c filename or -1 for both if it
+  cannot be read
+*/
+inline std::pair<std::int64_t,std::int64_t>
+file_state(const std::string &filename)
+{
+  struct stat st;
+  if(::stat(filename.c_str(),&st) != 0)
+    return std::make_pair(std::int64_t(-1),std::int64_t(-1));
+
+  return std::make_pair(static_cast<std::int64_t>(st.st_size),
+    modification_time(st));
+}
+
+/*
+  The `NAME=VALUE` strings in \c env starting with \c prefix in sorted
+  order
+*/
+inline std::vector<std::string>
+environment_variables(const std::string &prefix, const char * const *env)
+{
+  std::vector<std::string> result;
+  for(; env && *env; ++env) {
+    if(std::strncmp(*env,prefix.c_str(),prefix.size()) == 0 &&
+      std::strchr(*env,'='))
+    {
+      result.push_back(*env);
+    }
+  }
+
+  std::sort(result.begin(),result.end());
+
+  return result;
+}
+
+inline void put_bytes(std::string &out, const void *data, std::size_t size)
+{
+  out.append(static_cast<const char *>(data),size);
+}
+
+template<typename T>
+inline void put_value(std::string &out, const T &val)
+{
+  put_bytes(out,&val,sizeof(val));
+}
+
+// strings are prefixed by their length so that concatenations differ
+template<typename CharT>
+inline void put_string(std::string &out, const std::basic_string<CharT> &str)
+{
+  put_value(out,static_cast<std::uint64_t>(str.size()));
+  put_bytes(out,str.data(),str.size()*sizeof(CharT));
+}
+
+template<typename CharT>
+inline void put_string(std::string &out, const CharT *str)
+{
+  put_string(out,std::basic_string<CharT>(str));
+}
+
+/*
+  Reads what put_value and put_string wrote. Each read returns false if
+  the data ends first.
+*/
+class byte_reader {
+  public:
+    byte_reader(const char *first, const char *last)
+      :_cur(first), _last(last) {}
+
+    bool get_bytes(const char *&data, std::size_t size) {
+      if(static_cast<std::size_t>(_last-_cur) < size)
+        return false;
+
+      data = _cur;
+      _cur += size;
+      return true;
+    }
+
+    template<typename T>
+    bool get_value(T &val) {
+      const char *data;
+      if(!get_bytes(data,sizeof(val)))
+        return false;
+
+      std::memcpy(&val,data,sizeof(val));
+      return true;
+    }
+
+    // the bytes of a string in place
+    bool get_sized(const char *&data, std::size_t &size) {
+      std::uint64_t len;
+      if(!get_value(len) ||
+        len > static_cast<std::uint64_t>(_last-_cur))
+      {
+        return false;
+      }
+
+      size = static_cast<std::size_t>(len);
+      return get_bytes(data,size);
+    }
+
+    bool get_string(std::string &str) {
+      const char *data;
+      std::size_t size;
+      if(!get_sized(data,size))
+        return false;
+
+      str.assign(data,size);
+      return true;
+    }
+
+    const char * position(void) const {
+      return _cur;
+    }
+
+  private:
+    const char *_cur;
+    const char *_last;
+};
+
+}
+
+/*
+  The files and environment variables read by a parse besides its
+  arguments. Each file is kept with its size and modification time when
+  it was opened and each scan of the environment with the variables it
+  saw. basic_parse_cache records these from the response files,
+  configuration files, and environment sources used by a parse and only
+  uses its result while they are current.
+*/
+struct parse_dependencies {
+  struct file_type {
+    std::string filename;
+    std::int64_t size;
+    std::int64_t mtime;
+  };
+
+  struct environment_type {
+    std::string prefix;
+    std::vector<std::string> variables;
+  };
+
+  std::vector<file_type> files;
+  std::vector<environment_type> environment;
+
+  /*
+    True if every file and the environment of the process are as they
+    were recorded
+  */
+  bool current(void) const {
+    for(auto &file : files) {
+      if(detail::file_state(file.filename) !=
+        std::make_pair(file.size,file.mtime))
+      {
+        return false;
+      }
+    }
+
+    for(auto &env : environment) {
+      if(detail::environment_variables(env.prefix,
+        detail::process_environment()) != env.variables)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+};
+
+namespace detail {
+
+/*
+  Add to \c deps what the parses on this thread read while this object
+  exists. What is read is also passed on to an enclosing recorder.
+*/
+class dependency_recorder {
+  public:
+    explicit dependency_recorder(parse_dependencies &deps)
+      :_previous(current_source_observer())
+    {
+      source_observer *previous = _previous;
+
+      _observer.file = [&deps,previous](const std::string &filename) {
+        std::pair<std::int64_t,std::int64_t> state = file_state(filename);
+        deps.files.push_back(
+          parse_dependencies::file_type{filename,state.first,state.second});
+
+        if(previous && previous->file)
+          previous->file(filename);
+      };
+
+      _observer.environment = [&deps,previous](const std::string &prefix,
+        const char * const *env)
+      {
+        deps.environment.push_back(parse_dependencies::environment_type{
+          prefix,environment_variables(prefix,env)});
+
+        if(previous && previous->environment)
+          previous->environment(prefix,env);
+      };
+
+      current_source_observer() = &_observer;
+    }
+
+    dependency_recorder(const dependency_recorder &) = delete;
+    dependency_recorder & operator=(const dependency_recorder &) = delete;
+
+    ~dependency_recorder(void) {
+      current_source_observer() = _previous;
+    }
+
+  private:
+    source_observer _observer;
+    source_observer *_previous;
+};
+
+inline void put_dependencies(std::string &out,
+  const parse_dependencies &deps)
+{
+  put_value(out,static_cast<std::uint64_t>(deps.files.size()));
+  for(auto &file : deps.files) {
+    put_string(out,file.filename);
+    put_value(out,file.size);
+    put_value(out,file.mtime);
+  }
+
+  put_value(out,static_cast<std::uint64_t>(deps.environment.size()));
+  for(auto &env : deps.environment) {
+    put_string(out,env.prefix);
+    put_value(out,static_cast<std::uint64_t>(env.variables.size()));
+    for(auto &var : env.variables)
+      put_string(out,var);
+  }
+}
+
+inline bool get_dependencies(byte_reader &in, parse_dependencies &deps)
+{
+  std::uint64_t count;
+  if(!in.get_value(count))
+    return false;
+
+  for(std::uint64_t i=0; i<count; ++i) {
+    parse_dependencies::file_type file;
+    if(!in.get_string(file.filename) || !in.get_value(file.size) ||
+      !in.get_value(file.mtime))
+    {
+      return false;
+    }
+    deps.files.push_back(std::move(file));
+  }
+
+  if(!in.get_value(count))
+    return false;
+
+  for(std::uint64_t i=0; i<count; ++i) {
+    parse_dependencies::environment_type env;
+    std::uint64_t vars;
+    if(!in.get_string(env.prefix) || !in.get_value(vars))
+      return false;
+
+    for(std::uint64_t j=0; j<vars; ++j) {
+      std::string var;
+      if(!in.get_string(var))
+        return false;
+      env.variables.push_back(std::move(var));
+    }
+    deps.environment.push_back(std::move(env));
+  }
+
+  return true;
+}
+
+/*
+  A result file of basic_parse_cache starts with this followed by the
+  key material and the dependencies, each prefixed by their size, and
+  then the snapshot of the variable map at the next multiple of 8 bytes.
+*/
+static const char parse_cache_magic[8] = {'c','m','d','c','a','c','h','e'};
+
+}
+
+/*
+  A cache of parse results kept in a directory and shared by every
+  invocation of a program.
+
+  Each result is stored with a snapshot (see snapshot.h) of its variable
+  map under the fingerprint of what produced it: the arguments, the
+  structure of the options group, and the modification time and size of
+  each source file given such as a configuration file. The structure of
+  the group is taken from which functions each description provides and
+  from the key, value, and implicit value descriptions. Changes to a
+  description that are not visible there, for example to a constraint or
+  to a conversion, are not seen and so \c salt should be changed with
+  them, for example to the version of the program.
+
+  The file of a result is named for the 64 bit hash of the fingerprint.
+  The full fingerprint is stored in the file and compared when it is read
+  so that two fingerprints with the same hash never share a result.
+
+  The response files, configuration files, and environment sources that
+  the parse reads on a miss are recorded as parse_dependencies and stored
+  with the result. They need not be given as sources. A result is only
+  used while each recorded file has the same size and modification time
+  and the environment variables read have the same values.
+
+  On a hit only the variable map is recreated. Nothing is parsed, so
+  variables bound with `basic_value<T>(T *)` are not assigned and value
+  callbacks and finalize functions are not run. Programs using the cache
+  should read their values from the returned variable map.
+
+  Files are written to a temporary name and renamed into place so that
+  other invocations never read a partial result. A result that is used
+  has its modification time updated. When the files in the directory
+  exceed \c max_size bytes, the least recently used are removed along
+  with temporary files older than stale_seconds, which were left by
+  writers that did not finish. The directory is only listed to check
+  this when the results stored through this cache since the last check
+  would take it past \c max_size, or for about one in every
+  evict_interval stores so that the results of other invocations are
+  counted. In between, the directory can grow past \c max_size. A result
+  that cannot be read is treated as a miss and a result that cannot be
+  written is not cached, so the cache never causes a parse to fail. All
+  values in a result must be able to be stored in a snapshot.
+
+  Requires POSIX file system calls.
+*/
+template<typename CharT>
+class basic_parse_cache {
+  public:
+    typedef std::basic_string<CharT> string_type;
+    typedef basic_options_group<CharT> options_group_type;
+    typedef basic_variable_map<CharT> variable_map_type;
+
+    static const unsigned evict_interval = 16;
+    static const unsigned stale_seconds = 600;
+
+    /*
+      The bytes of everything that went into a fingerprint and their
+      hash
+    */
+    struct key_type {
+      std::uint64_t hash;
+      std::string material;
+    };
+
+    basic_parse_cache(const std::string &directory,
+      std::uintmax_t max_size = 64*1024*1024,
+      const std::string &salt = std::string())
+        :_directory(directory), _max_size(max_size), _salt(salt),
+          _estimated_size(std::make_shared<std::atomic<std::uintmax_t> >(0))
+    {}
+
+    const std::string & directory(void) const {
+      return _directory;
+    }
+
+    /*
+      The fingerprint of parsing the arguments [first,last) with \c grp
+      and the files \c sources
+    */
+    template<typename ArgIter>
+    key_type
+    fingerprint(ArgIter first, ArgIter last, const options_group_type &grp,
+      const std::vector<std::string> &sources = {}) const;
+
+    /*
+      The cached result for \c key or false if there is none or its
+      dependencies changed
+    */
+    bool find(const key_type &key, variable_map_type &vm) const;
+
+    /*
+      Cache \c vm as the result for \c key. It is only used while \c deps
+      are current.
+    */
+    void store(const key_type &key, const variable_map_type &vm,
+      const parse_dependencies &deps = parse_dependencies()) const;
+
+    /*
+      The cached result of parsing the arguments [first,last) with \c grp
+      and the files \c sources. On a miss \c parse_fn is called to produce
+      it with full parsing and validation and what it reads is recorded.
+      Exceptions from \c parse_fn are passed on and nothing is cached. On
+      a hit \c parse_fn is not called and so bound variables are not
+      assigned.
+    */
+    template<typename ArgIter, typename ParseFn>
+    variable_map_type
+    parse(ArgIter first, ArgIter last, const options_group_type &grp,
+      const std::vector<std::string> &sources, const ParseFn &parse_fn) const
+    {
+      key_type key = fingerprint(first,last,grp,sources);
+
+      variable_map_type vm;
+      if(!find(key,vm)) {
+        parse_dependencies deps;
+        {
+          detail::dependency_recorder recorder(deps);
+          vm = parse_fn();
+        }
+
+        store(key,vm,deps);
+      }
+
+      return vm;
+    }
+
+    /*
+      Remove stale temporary files and the least recently used results
+      until the cache is no larger than max_size
+    */
+    void evict(void) const;
+
+  private:
+    std::string _directory;
+    std::uintmax_t _max_size;
+    std::string _salt;
+
+    // the size of the directory when last listed plus the results stored
+    // since, shared by copies
+    std::shared_ptr<std::atomic<std::uintmax_t> > _estimated_size;
+
+    std::string path(std::uint64_t hash) const {
+      char name[32];
+      std::snprintf(name,sizeof(name),"%016llx.snap",
+        static_cast<unsigned long long>(hash));
+      return _directory + "/" + name;
+    }
+};
+
+template<typename CharT>
+template<typename ArgIter>
+typename basic_parse_cache<CharT>::key_type
+basic_parse_cache<CharT>::fingerprint(ArgIter first, ArgIter last,
+  const options_group_type &grp,
+  const std::vector<std::string> &sources) const
+{
+  key_type key;
+  std::string &material = key.material;
+
+  detail::put_value(material,detail::snapshot_version);
+  detail::put_value(material,static_cast<std::uint32_t>(sizeof(CharT)));
+  detail::put_string(material,_salt);
+
+  detail::put_value(material,
+    static_cast<std::uint64_t>(std::distance(first,last)));
+  for(; first != last; ++first)
+    detail::put_string(material,*first);
+
+  detail::put_value(material,static_cast<std::uint64_t>(grp.size()));
+  for(auto &desc : grp) {
+    std::uint32_t provides =
+      (desc.unpack_option ? 1 : 0) | (desc.mapped_key ? 2 : 0) |
+      (desc.make_value ? 4 : 0) | (desc.make_implicit_value ? 8 : 0) |
+      (desc.finalize ? 16 : 0);
+    detail::put_value(material,provides);
+
+    detail::put_string(material,desc.key_description ?
+      desc.key_description() : string_type());
+    detail::put_string(material,desc.value_description ?
+      desc.value_description() : string_type());
+    detail::put_string(material,desc.implicit_value_description ?
+      desc.implicit_value_description() : string_type());
+  }
+
+  detail::put_value(material,static_cast<std::uint64_t>(sources.size()));
+  for(auto &source : sources) {
+    detail::put_string(material,source);
+
+    struct stat st;
+    if(::stat(source.c_str(),&st) != 0) {
+      detail::put_value(material,std::int64_t(-1));
+      continue;
+    }
+
+    detail::put_value(material,static_cast<std::int64_t>(st.st_size));
+    detail::put_value(material,detail::modification_time(st));
+    detail::put_value(material,static_cast<std::uint64_t>(st.st_ino));
+  }
+
+  key.hash =
+    detail::fnv1a_hash().add(material.data(),material.size()).value();
+
+  return key;
+}
+
+template<typename CharT>
+bool basic_parse_cache<CharT>::find(const key_type &key,
+  variable_map_type &vm) const
+{
+  std::string filename = path(key.hash);
+
+  try {
+    detail::mapped_snapshot file = detail::map_snapshot(filename);
+    detail::byte_reader in(file.data,file.data+file.size);
+
+    const char *magic;
+    const char *material;
+    std::size_t material_size;
+    if(!in.get_bytes(magic,sizeof(detail::parse_cache_magic)) ||
+      std::memcmp(magic,detail::parse_cache_magic,
+        sizeof(detail::parse_cache_magic)) != 0 ||
+      !in.get_sized(material,material_size) ||
+      material_size != key.material.size() ||
+      std::memcmp(material,key.material.data(),material_size) != 0)
+    {
+      return false;
+    }
+
+    const char *deps_data;
+    std::size_t deps_size;
+    parse_dependencies deps;
+    if(!in.get_sized(deps_data,deps_size))
+      return false;
+
+    detail::byte_reader deps_in(deps_data,deps_data+deps_size);
+    if(!detail::get_dependencies(deps_in,deps) || !deps.current())
+      return false;
+
+    std::size_t offset = detail::snapshot_align(
+      static_cast<std::size_t>(in.position()-file.data));
+    if(offset > file.size)
+      return false;
+
+    vm = read_snapshot<CharT>(file.data+offset,file.size-offset,filename);
+  }
+  catch(const snapshot_error &) {
+    return false;
+  }
+
+  // mark as recently used
+  ::utime(filename.c_str(),nullptr);
+
+  return true;
+}
+
+template<typename CharT>
+void basic_parse_cache<CharT>::store(const key_type &key,
+  const variable_map_type &vm, const parse_dependencies &deps) const
+{
+  std::string filename = path(key.hash);
+
+  std::string deps_data;
+  detail::put_dependencies(deps_data,deps);
+
+  std::string data(detail::parse_cache_magic,
+    sizeof(detail::parse_cache_magic));
+  detail::put_string(data,key.material);
+  detail::put_string(data,deps_data);
+
+  // keep the values in the snapshot aligned as they are in its own file
+  data.resize(detail::snapshot_align(data.size()),'\0');
+
+  try {
+    data.append(make_snapshot(vm,filename));
+    detail::replace_snapshot_file(filename,data);
+  }
+  catch(const snapshot_error &) {
+    return;
+  }
+
+  std::uintmax_t estimate =
+    (*_estimated_size += static_cast<std::uintmax_t>(data.size()));
+
+  // the key is a hash so its low bits select an even sample of stores
+  if(estimate > _max_size || key.hash % evict_interval == 0)
+    evict();
+}
+
+template<typename CharT>
+void basic_parse_cache<CharT>::evict(void) const
+{
+  struct cached_file {
+    std::string filename;
+    std::uintmax_t size;
+    std::int64_t mtime;
+  };
+
+  DIR *dir = ::opendir(_directory.c_str());
+  if(!dir)
+    return;
+
+  std::vector<cached_file> files;
+  std::uintmax_t total = 0;
+  std::time_t now = std::time(nullptr);
+
+  auto ends_with = [](const std::string &name, const char *suffix) {
+    std::size_t len = std::strlen(suffix);
+    return (name.size() >= len &&
+      name.compare(name.size()-len,len,suffix) == 0);
+  };
+
+  while(struct dirent *ent = ::readdir(dir)) {
+    std::string name = ent->d_name;
+
+    // temporary files are named for the result followed by .<pid>.<n>.tmp
+    bool is_tmp =
+      (ends_with(name,".tmp") && name.find(".snap.") != std::string::npos);
+    if(!is_tmp && !ends_with(name,".snap"))
+      continue;
+
+    std::string filename = _directory + "/" + name;
+    struct stat st;
+    if(::stat(filename.c_str(),&st) != 0)
+      continue;
+
+    std::uintmax_t size = static_cast<std::uintmax_t>(st.st_size);
+
+    if(is_tmp) {
+      // a writer that is still running is counted but left alone
+      if(now-st.st_mtime < static_cast<std::time_t>(stale_seconds) ||
+        std::remove(filename.c_str()) != 0)
+      {
+        total += size;
+      }
+      continue;
+    }
+
+    files.push_back(cached_file{filename,size,
+      detail::modification_time(st)});
+    total += size;
+  }
+
+  ::closedir(dir);
+
+  if(total <= _max_size) {
+    *_estimated_size = total;
+    return;
+  }
+
+  std::sort(files.begin(),files.end(),
+    [](const cached_file &lhs, const cached_file &rhs) {
+      return lhs.mtime < rhs.mtime;
+    });
+
+  for(auto &file : files) {
+    if(total <= _max_size)
+      break;
+
+    if(std::remove(file.filename.c_str()) == 0)
+      total -= file.size;
+  }
+
+  *_estimated_size = total;
+}
+
+template<typename CharT>
+const unsigned basic_parse_cache<CharT>::evict_interval;
+
+template<typename CharT>
+const unsigned basic_parse_cache<CharT>::stale_seconds;
+
+typedef basic_parse_cache<char> parse_cache;
+typedef basic_parse_cache<wchar_t> wparse_cache;
+
+}
+
+#endif
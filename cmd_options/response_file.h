@@ -0,0 +1,338 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_RESPONSE_FILE_H
+#define CMD_OPTIONS_RESPONSE_FILE_H
+
+#include "cmd_options.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define CMD_OPTIONS_HAVE_MMAP 1
+#endif
+
+namespace cmd_options {
+
+/*
+  Thrown when a response file cannot be read. \c error() is the errno
+  value of the failed call.
+*/
+class response_file_error : public std::runtime_error {
+  public:
+    response_file_error(const std::string &filename, int err)
+      :std::runtime_error("response_file_error"), _filename(filename),
+        _error(err) {}
+
+    const char * filename(void) const noexcept {
+      return _filename.what();
+    }
+
+    int error(void) const noexcept {
+      return _error;
+    }
+
+  protected:
+    response_file_error(const std::string &what, const std::string &filename,
+      int err)
+        :std::runtime_error(what), _filename(filename), _error(err) {}
+
+  private:
+    std::runtime_error _filename;
+    int _error;
+};
+
+/*
+  Thrown when a response file includes itself either directly or through
+  other response files
+*/
+class response_file_cycle_error : public response_file_error {
+  public:
+    response_file_cycle_error(const std::string &filename)
+      :response_file_error("response_file_cycle_error",filename,0) {}
+};
+
+namespace detail {
+
+/*
+  The contents of a file mapped privately into memory so that it can be
+  modified in place without changing the file. Where mmap is not
+  available the file is read into memory instead.
+*/
+class mapped_file {
+  public:
+    explicit mapped_file(const std::string &filename)
+      :_data(nullptr), _size(0)
+    {
+#ifdef CMD_OPTIONS_HAVE_MMAP
+      int fd = ::open(filename.c_str(),O_RDONLY);
+      if(fd < 0)
+        throw response_file_error(filename,errno);
+
+      struct stat st;
+      if(::fstat(fd,&st) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw response_file_error(filename,err);
+      }
+
+      _device = static_cast<std::uintmax_t>(st.st_dev);
+      _inode = static_cast<std::uintmax_t>(st.st_ino);
+      _size = static_cast<std::size_t>(st.st_size);
+
+      if(_size) {
+        void *addr = ::mmap(nullptr,_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,
+          fd,0);
+        if(addr == MAP_FAILED) {
+          int err = errno;
+          ::close(fd);
+          throw response_file_error(filename,err);
+        }
+        _data = static_cast<char *>(addr);
+      }
+
+      ::close(fd);
+#else
+      std::ifstream in(filename.c_str(),std::ios::binary);
+      if(!in)
+        throw response_file_error(filename,errno);
+
+      _buffer.assign(std::istreambuf_iterator<char>(in),
+        std::istreambuf_iterator<char>());
+      _data = _buffer.data();
+      _size = _buffer.size();
+      _device = 0;
+      _inode = std::hash<std::string>()(filename);
+#endif
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file & operator=(const mapped_file &) = delete;
+
+    ~mapped_file(void) {
+#ifdef CMD_OPTIONS_HAVE_MMAP
+      if(_data)
+        ::munmap(_data,_size);
+#endif
+    }
+
+    char * data(void) {
+      return _data;
+    }
+
+    std::size_t size(void) const {
+      return _size;
+    }
+
+    /*
+      Identifies the file regardless of the name used to open it
+    */
+    std::pair<std::uintmax_t,std::uintmax_t> id(void) const {
+      return std::make_pair(_device,_inode);
+    }
+
+  private:
+    char *_data;
+    std::size_t _size;
+    std::uintmax_t _device;
+    std::uintmax_t _inode;
+#ifndef CMD_OPTIONS_HAVE_MMAP
+    std::vector<char> _buffer;
+#endif
+};
+
+}
+
+/*
+  Arguments with response files expanded.
+
+  Each argument of the form `@file` is replaced by the arguments contained
+  in `file`. Arguments in a response file are separated by whitespace and
+  may be quoted as in the shell: text within single quotes is taken as
+  is, text within double quotes is taken as is except that a backslash
+  escapes a following `"` or `\`, and elsewhere a backslash escapes any
+  following character. An unquoted argument in a response file that
+  starts with `@` is itself a response file which is expanded in place.
+  File names are relative to the working directory. A response file that
+  includes itself, directly or not, results in a
+  response_file_cycle_error.
+
+  Response files are mapped into memory privately and tokenized in a
+  single pass. Each argument is unquoted and terminated in place so the
+  result is a sequence of `const char *` into the mapped files rather than
+  a copy of each argument. The mappings live as long as this object. For
+  example:
+
+    cmd_options::response_files args(argv+1,argv+argc);
+    std::tie(res,vm) =
+      cmd_options::parse_arguments(args.begin(),args.end(),grp);
+
+  Arguments not naming response files are referred to in place and so the
+  given range must also outlive this object.
+*/
+class response_files {
+  public:
+    typedef std::vector<const char *>::const_iterator const_iterator;
+
+    template<typename InputIterator>
+    response_files(InputIterator first, InputIterator last) {
+      for(; first != last; ++first)
+        add_argument(c_str(*first));
+    }
+
+    response_files(response_files &&) = default;
+    response_files & operator=(response_files &&) = default;
+
+    const_iterator begin(void) const {
+      return _args.begin();
+    }
+
+    const_iterator end(void) const {
+      return _args.end();
+    }
+
+    std::size_t size(void) const {
+      return _args.size();
+    }
+
+    const char * operator[](std::size_t n) const {
+      return _args[n];
+    }
+
+  private:
+    std::vector<const char *> _args;
+    std::vector<std::unique_ptr<detail::mapped_file> > _files;
+    std::vector<std::unique_ptr<std::string> > _tails;
+
+    // files currently being expanded
+    std::vector<std::pair<std::uintmax_t,std::uintmax_t> > _open;
+
+    static const char * c_str(const char *arg) {
+      return arg;
+    }
+
+    static const char * c_str(const std::string &arg) {
+      return arg.c_str();
+    }
+
+    void add_argument(const char *arg) {
+      if(arg[0] == '@' && arg[1] != '\0')
+        expand(arg+1);
+      else
+        _args.push_back(arg);
+    }
+
+    void expand(const std::string &filename);
+};
+
+inline void response_files::expand(const std::string &filename)
+{
+  _files.emplace_back(new detail::mapped_file(filename));
+  detail::mapped_file &file = *(_files.back());
+  detail::observe_file(filename);
+
+  if(std::find(_open.begin(),_open.end(),file.id()) != _open.end())
+    throw response_file_cycle_error(filename);
+
+  _open.push_back(file.id());
+
+  auto is_space = [](char c) {
+    return (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+      c == '\f');
+  };
+
+  char *cur = file.data();
+  char *last = cur+file.size();
+
+  while(cur != last) {
+    if(is_space(*cur)) {
+      ++cur;
+      continue;
+    }
+
+    // unquote in place: `out` never passes `cur`
+    char *first = cur;
+    char *out = cur;
+    bool nested = (*cur == '@');
+    char quote = '\0';
+
+    for(; cur != last && (quote || !is_space(*cur)); ++cur) {
+      if(quote == '\'') {
+        if(*cur == '\'')
+          quote = '\0';
+        else
+          *out++ = *cur;
+      }
+      else if(quote == '"') {
+        if(*cur == '"')
+          quote = '\0';
+        else if(*cur == '\\' && (cur+1) != last &&
+          (*(cur+1) == '"' || *(cur+1) == '\\'))
+        {
+          *out++ = *++cur;
+        }
+        else
+          *out++ = *cur;
+      }
+      else if(*cur == '\'' || *cur == '"')
+        quote = *cur;
+      else if(*cur == '\\' && (cur+1) != last)
+        *out++ = *++cur;
+      else
+        *out++ = *cur;
+    }
+
+    const char *arg = first;
+    if(out != last)
+      *out = '\0';
+    else {
+      // no room to terminate the last argument of the file
+      _tails.emplace_back(new std::string(first,out));
+      arg = _tails.back()->c_str();
+    }
+
+    if(cur != last)
+      ++cur;
+
+    if(nested && arg[1] != '\0')
+      expand(arg+1);
+    else
+      _args.push_back(arg);
+  }
+
+  _open.pop_back();
+}
+
+}
+
+#endif
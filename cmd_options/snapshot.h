@@ -0,0 +1,640 @@
+/**
+ *  Copyright (c) 2017-2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CMD_OPTIONS_SNAPSHOT_H
+#define CMD_OPTIONS_SNAPSHOT_H
+
+#include "cmd_options.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace cmd_options {
+
+/*
+  Thrown when a snapshot cannot be written or read. \c reason() describes
+  the problem.
+*/
+class snapshot_error : public std::runtime_error {
+  public:
+    snapshot_error(const std::string &filename, const std::string &reason)
+      :std::runtime_error("snapshot_error"), _filename(filename),
+        _reason(reason) {}
+
+    const char * filename(void) const noexcept {
+      return _filename.what();
+    }
+
+    const char * reason(void) const noexcept {
+      return _reason.what();
+    }
+
+  private:
+    std::runtime_error _filename;
+    std::runtime_error _reason;
+};
+
+/*
+  Type tags of the values stored in a snapshot. Tags below \c
+  snapshot_user are reserved for the built-in types.
+*/
+enum snapshot_tag : std::uint32_t {
+  snapshot_empty = 0,
+  snapshot_bool,
+  snapshot_char,
+  snapshot_signed_char,
+  snapshot_unsigned_char,
+  snapshot_wchar,
+  snapshot_char16,
+  snapshot_char32,
+  snapshot_short,
+  snapshot_unsigned_short,
+  snapshot_int,
+  snapshot_unsigned_int,
+  snapshot_long,
+  snapshot_unsigned_long,
+  snapshot_long_long,
+  snapshot_unsigned_long_long,
+  snapshot_float,
+  snapshot_double,
+  snapshot_long_double,
+  snapshot_string,
+  snapshot_wstring,
+  snapshot_u16string,
+  snapshot_u32string,
+  snapshot_user = 256
+};
+
+namespace detail {
+
+/*
+  The layout of a snapshot. All fields are in host byte order and
+  offsets are from the start of the snapshot. The header is followed by
+  one entry per value in key order and then by the keys and the values
+  too large to be stored in their entry, each aligned to 8 bytes.
+*/
+struct snapshot_header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t char_size;
+  std::uint32_t reserved;
+  std::uint64_t count;
+  std::uint64_t size;
+};
+
+struct snapshot_entry {
+  std::uint64_t key_offset;
+  std::uint32_t key_length;
+  std::uint32_t tag;
+  std::uint64_t value_length;
+  // the value itself if value_length <= 8, otherwise its offset
+  std::uint64_t value;
+};
+
+static const char snapshot_magic[8] = {'c','m','d','o','p','t','s','\0'};
+static const std::uint32_t snapshot_version = 1;
+static const std::uint32_t snapshot_byte_order = 0x01020304;
+
+/*
+  The tag of T if it is one of the built-in types and snapshot_empty
+  otherwise
+*/
+template<typename T>
+struct snapshot_builtin_tag
+  :std::integral_constant<std::uint32_t,snapshot_empty> {};
+
+template<> struct snapshot_builtin_tag<bool>
+  :std::integral_constant<std::uint32_t,snapshot_bool> {};
+template<> struct snapshot_builtin_tag<char>
+  :std::integral_constant<std::uint32_t,snapshot_char> {};
+template<> struct snapshot_builtin_tag<signed char>
+  :std::integral_constant<std::uint32_t,snapshot_signed_char> {};
+template<> struct snapshot_builtin_tag<unsigned char>
+  :std::integral_constant<std::uint32_t,snapshot_unsigned_char> {};
+template<> struct snapshot_builtin_tag<wchar_t>
+  :std::integral_constant<std::uint32_t,snapshot_wchar> {};
+template<> struct snapshot_builtin_tag<char16_t>
+  :std::integral_constant<std::uint32_t,snapshot_char16> {};
+template<> struct snapshot_builtin_tag<char32_t>
+  :std::integral_constant<std::uint32_t,snapshot_char32> {};
+template<> struct snapshot_builtin_tag<short>
+  :std::integral_constant<std::uint32_t,snapshot_short> {};
+template<> struct snapshot_builtin_tag<unsigned short>
+  :std::integral_constant<std::uint32_t,snapshot_unsigned_short> {};
+template<> struct snapshot_builtin_tag<int>
+  :std::integral_constant<std::uint32_t,snapshot_int> {};
+template<> struct snapshot_builtin_tag<unsigned int>
+  :std::integral_constant<std::uint32_t,snapshot_unsigned_int> {};
+template<> struct snapshot_builtin_tag<long>
+  :std::integral_constant<std::uint32_t,snapshot_long> {};
+template<> struct snapshot_builtin_tag<unsigned long>
+  :std::integral_constant<std::uint32_t,snapshot_unsigned_long> {};
+template<> struct snapshot_builtin_tag<long long>
+  :std::integral_constant<std::uint32_t,snapshot_long_long> {};
+template<> struct snapshot_builtin_tag<unsigned long long>
+  :std::integral_constant<std::uint32_t,snapshot_unsigned_long_long> {};
+template<> struct snapshot_builtin_tag<float>
+  :std::integral_constant<std::uint32_t,snapshot_float> {};
+template<> struct snapshot_builtin_tag<double>
+  :std::integral_constant<std::uint32_t,snapshot_double> {};
+template<> struct snapshot_builtin_tag<long double>
+  :std::integral_constant<std::uint32_t,snapshot_long_double> {};
+template<> struct snapshot_builtin_tag<std::string>
+  :std::integral_constant<std::uint32_t,snapshot_string> {};
+template<> struct snapshot_builtin_tag<std::wstring>
+  :std::integral_constant<std::uint32_t,snapshot_wstring> {};
+template<> struct snapshot_builtin_tag<std::u16string>
+  :std::integral_constant<std::uint32_t,snapshot_u16string> {};
+template<> struct snapshot_builtin_tag<std::u32string>
+  :std::integral_constant<std::uint32_t,snapshot_u32string> {};
+
+/*
+  The serializers of each value type that may be stored in a snapshot
+*/
+class snapshot_registry {
+  public:
+    typedef std::function<void(const any &, std::string &)> save_fn;
+    typedef std::function<any(const char *, std::size_t)> load_fn;
+
+    struct serializer {
+      std::uint32_t tag;
+      std::type_index type;
+      save_fn save;
+      load_fn load;
+    };
+
+    typedef std::shared_ptr<const serializer> serializer_ptr;
+
+    static snapshot_registry & instance(void) {
+      static snapshot_registry registry;
+      return registry;
+    }
+
+    /*
+      Store values of type T under \c tag. A tag belongs to a single type
+      and the tags of the built-in types cannot be changed. Registering a
+      type again under a new tag replaces its previous tag.
+    */
+    template<typename T>
+    void add(std::uint32_t tag, const save_fn &save, const load_fn &load) {
+      std::type_index type(typeid(T));
+
+      std::lock_guard<std::mutex> lock(_guard);
+
+      auto loc = _serializers.find(tag);
+      if(loc != _serializers.end() && loc->second->type != type)
+        throw std::invalid_argument("snapshot tag registered for another type");
+
+      auto prev = _tags.find(type);
+      if(prev != _tags.end() && prev->second != tag) {
+        if(prev->second < snapshot_user)
+          throw std::invalid_argument("built-in snapshot type");
+
+        _serializers.erase(prev->second);
+      }
+
+      _tags[type] = tag;
+      _serializers[tag] =
+        std::make_shared<const serializer>(serializer{tag,type,save,load});
+    }
+
+    /*
+      The serializer for \c type or null if there is none. The serializer
+      is shared so that it stays valid if its type is registered again.
+    */
+    serializer_ptr find(const std::type_info &type) const {
+      std::lock_guard<std::mutex> lock(_guard);
+      auto loc = _tags.find(std::type_index(type));
+      return (loc == _tags.end() ? nullptr : _serializers.at(loc->second));
+    }
+
+    serializer_ptr find(std::uint32_t tag) const {
+      std::lock_guard<std::mutex> lock(_guard);
+      auto loc = _serializers.find(tag);
+      return (loc == _serializers.end() ? nullptr : loc->second);
+    }
+
+  private:
+    mutable std::mutex _guard;
+    std::unordered_map<std::type_index,std::uint32_t> _tags;
+    std::unordered_map<std::uint32_t,serializer_ptr> _serializers;
+
+    snapshot_registry(void) {
+      add_trivial<bool>(snapshot_bool);
+      add_trivial<char>(snapshot_char);
+      add_trivial<signed char>(snapshot_signed_char);
+      add_trivial<unsigned char>(snapshot_unsigned_char);
+      add_trivial<wchar_t>(snapshot_wchar);
+      add_trivial<char16_t>(snapshot_char16);
+      add_trivial<char32_t>(snapshot_char32);
+      add_trivial<short>(snapshot_short);
+      add_trivial<unsigned short>(snapshot_unsigned_short);
+      add_trivial<int>(snapshot_int);
+      add_trivial<unsigned int>(snapshot_unsigned_int);
+      add_trivial<long>(snapshot_long);
+      add_trivial<unsigned long>(snapshot_unsigned_long);
+      add_trivial<long long>(snapshot_long_long);
+      add_trivial<unsigned long long>(snapshot_unsigned_long_long);
+      add_trivial<float>(snapshot_float);
+      add_trivial<double>(snapshot_double);
+      add_trivial<long double>(snapshot_long_double);
+      add_string<char>(snapshot_string);
+      add_string<wchar_t>(snapshot_wstring);
+      add_string<char16_t>(snapshot_u16string);
+      add_string<char32_t>(snapshot_u32string);
+    }
+
+    template<typename T>
+    void add_trivial(std::uint32_t tag) {
+      add<T>(tag,
+        [](const any &val, std::string &out) {
+          const T &_val = any_cast<const T &>(val);
+          out.append(reinterpret_cast<const char *>(&_val),sizeof(T));
+        },
+        [](const char *data, std::size_t size) {
+          if(size != sizeof(T))
+            throw std::runtime_error("invalid value size");
+
+          T _val;
+          std::memcpy(&_val,data,sizeof(T));
+          return any(_val);
+        });
+    }
+
+    template<typename CharT>
+    void add_string(std::uint32_t tag) {
+      add<std::basic_string<CharT> >(tag,
+        [](const any &val, std::string &out) {
+          const std::basic_string<CharT> &str =
+            any_cast<const std::basic_string<CharT> &>(val);
+          out.append(reinterpret_cast<const char *>(str.data()),
+            str.size()*sizeof(CharT));
+        },
+        [](const char *data, std::size_t size) {
+          if(size % sizeof(CharT))
+            throw std::runtime_error("invalid value size");
+
+          std::basic_string<CharT> str(size/sizeof(CharT),CharT());
+          std::memcpy(&str[0],data,size);
+          return any(str);
+        });
+    }
+};
+
+inline std::size_t snapshot_align(std::size_t size)
+{
+  return (size+7) & ~std::size_t(7);
+}
+
+/*
+  Check the header of the snapshot in \c data and return it
+*/
+inline snapshot_header
+read_snapshot_header(const char *data, std::size_t size,
+  std::size_t char_size, const std::string &filename)
+{
+  snapshot_header header;
+  if(size < sizeof(header))
+    throw snapshot_error(filename,"truncated snapshot");
+
+  std::memcpy(&header,data,sizeof(header));
+  if(std::memcmp(header.magic,snapshot_magic,sizeof(snapshot_magic)) != 0)
+    throw snapshot_error(filename,"not a snapshot");
+
+  if(header.version != snapshot_version ||
+    header.byte_order != snapshot_byte_order ||
+    header.char_size != char_size)
+  {
+    throw snapshot_error(filename,"incompatible snapshot");
+  }
+
+  if(header.size != size ||
+    header.count > (size-sizeof(header))/sizeof(snapshot_entry))
+  {
+    throw snapshot_error(filename,"truncated snapshot");
+  }
+
+  return header;
+}
+
+/*
+  Read entry \c n of a snapshot whose header was checked and check that
+  its key and value lie within the snapshot
+*/
+inline snapshot_entry
+read_snapshot_entry(const char *data, std::size_t size, std::size_t n,
+  std::size_t char_size, const std::string &filename)
+{
+  snapshot_entry entry;
+  std::memcpy(&entry,data+sizeof(snapshot_header)+n*sizeof(entry),
+    sizeof(entry));
+
+  if(entry.key_offset > size ||
+    entry.key_length > (size-entry.key_offset)/char_size ||
+    (entry.value_length > sizeof(entry.value) &&
+      (entry.value > size || entry.value_length > size-entry.value)))
+  {
+    throw snapshot_error(filename,"invalid snapshot entry");
+  }
+
+  return entry;
+}
+
+/*
+  A snapshot file mapped shared and read only. The mapping is removed
+  when the last copy of \c owner is released.
+*/
+struct mapped_snapshot {
+  const char *data;
+  std::size_t size;
+  std::shared_ptr<const void> owner;
+};
+
+inline mapped_snapshot map_snapshot(const std::string &filename)
+{
+  int fd = ::open(filename.c_str(),O_RDONLY);
+  if(fd < 0)
+    throw snapshot_error(filename,"cannot read snapshot");
+
+  struct stat st;
+  if(::fstat(fd,&st) != 0) {
+    ::close(fd);
+    throw snapshot_error(filename,"cannot read snapshot");
+  }
+
+  // an empty file cannot be mapped
+  if(st.st_size == 0) {
+    ::close(fd);
+    throw snapshot_error(filename,"truncated snapshot");
+  }
+
+  std::size_t size = static_cast<std::size_t>(st.st_size);
+  void *addr = ::mmap(nullptr,size,PROT_READ,MAP_SHARED,fd,0);
+  ::close(fd);
+
+  if(addr == MAP_FAILED)
+    throw snapshot_error(filename,"cannot map snapshot");
+
+  return mapped_snapshot{static_cast<const char *>(addr),size,
+    std::shared_ptr<const void>(addr,[=](const void *) {
+      ::munmap(addr,size);
+    })};
+}
+
+/*
+  Replace \c filename with \c data. The data is written to a temporary
+  file in the same directory, named \c filename followed by
+  `.<pid>.<n>.tmp`, and renamed into place so that a reader that has the
+  file mapped keeps the previous contents and a new reader only ever sees
+  a complete file.
+*/
+inline void replace_snapshot_file(const std::string &filename,
+  const std::string &data)
+{
+  static std::atomic<unsigned> counter(0);
+
+  char suffix[64];
+  std::snprintf(suffix,sizeof(suffix),".%ld.%u.tmp",
+    static_cast<long>(::getpid()),counter++);
+  std::string tmp_filename = filename + suffix;
+
+  bool written = false;
+  {
+    std::ofstream out(tmp_filename.c_str(),std::ios::binary | std::ios::trunc);
+    written = (out.write(data.data(),data.size()) && out.flush());
+  }
+
+  if(!written || std::rename(tmp_filename.c_str(),filename.c_str()) != 0) {
+    std::remove(tmp_filename.c_str());
+    throw snapshot_error(filename,"cannot write snapshot");
+  }
+}
+
+/*
+  The bytes of the value of \c entry
+*/
+inline const char *
+snapshot_value(const char *data, const snapshot_entry &entry)
+{
+  if(entry.value_length <= sizeof(entry.value))
+    return reinterpret_cast<const char *>(&entry.value);
+
+  return data+entry.value;
+}
+
+}
+
+/*
+  Store values of type T in snapshots under \c tag using \c save to
+  append the bytes of a value to its argument and \c load to recreate a
+  value from them. \c tag must be at least snapshot_user, must not be
+  registered for another type, and must be the same each time the program
+  is run. Throws std::invalid_argument otherwise or if T is a built-in type.
+*/
+template<typename T>
+void register_snapshot_type(std::uint32_t tag,
+  const std::function<void(const T &, std::string &)> &save,
+  const std::function<T(const char *, std::size_t)> &load)
+{
+  if(tag < snapshot_user)
+    throw std::invalid_argument("reserved snapshot tag");
+
+  detail::snapshot_registry::instance().add<T>(tag,
+    [=](const any &val, std::string &out) {
+      save(any_cast<const T &>(val),out);
+    },
+    [=](const char *data, std::size_t size) {
+      return any(load(data,size));
+    });
+}
+
+/*
+  Serialize \c vm into a snapshot. Each value must be empty or of a
+  built-in arithmetic or string type or of a type given to
+  register_snapshot_type. Values that are at most 8 bytes are stored in
+  their entry.
+
+  A snapshot can only be read by a program built for the same byte order
+  and character type. It is meant as a cache of a parse rather than as
+  an interchange format.
+*/
+template<typename CharT>
+std::string make_snapshot(const basic_variable_map<CharT> &vm,
+  const std::string &filename = std::string())
+{
+  typedef detail::snapshot_registry registry_type;
+
+  registry_type &registry = registry_type::instance();
+
+  std::size_t table_end = sizeof(detail::snapshot_header) +
+    vm.size()*sizeof(detail::snapshot_entry);
+
+  std::string result(table_end,'\0');
+  std::string value;
+
+  std::size_t n = 0;
+  for(auto &pair : vm) {
+    detail::snapshot_entry entry{};
+
+    result.resize(detail::snapshot_align(result.size()),'\0');
+    entry.key_offset = result.size();
+    entry.key_length = static_cast<std::uint32_t>(pair.first.size());
+    result.append(reinterpret_cast<const char *>(pair.first.data()),
+      pair.first.size()*sizeof(CharT));
+
+    if(is_empty(pair.second))
+      entry.tag = snapshot_empty;
+    else {
+      registry_type::serializer_ptr ser = registry.find(pair.second.type());
+      if(!ser) {
+        throw snapshot_error(filename,
+          std::string("no serializer for ") + pair.second.type().name());
+      }
+
+      value.clear();
+      ser->save(pair.second,value);
+
+      entry.tag = ser->tag;
+      entry.value_length = value.size();
+      if(value.size() <= sizeof(entry.value))
+        std::memcpy(&entry.value,value.data(),value.size());
+      else {
+        result.resize(detail::snapshot_align(result.size()),'\0');
+        entry.value = result.size();
+        result.append(value);
+      }
+    }
+
+    std::memcpy(&result[sizeof(detail::snapshot_header)+n*sizeof(entry)],
+      &entry,sizeof(entry));
+    ++n;
+  }
+
+  result.resize(detail::snapshot_align(result.size()),'\0');
+
+  detail::snapshot_header header{};
+  std::memcpy(header.magic,detail::snapshot_magic,sizeof(header.magic));
+  header.version = detail::snapshot_version;
+  header.byte_order = detail::snapshot_byte_order;
+  header.char_size = sizeof(CharT);
+  header.count = vm.size();
+  header.size = result.size();
+  std::memcpy(&result[0],&header,sizeof(header));
+
+  return result;
+}
+
+/*
+  Recreate the variable map stored in the snapshot \c data of \c size
+  bytes as made by make_snapshot.
+*/
+template<typename CharT = char>
+basic_variable_map<CharT>
+read_snapshot(const char *data, std::size_t size,
+  const std::string &filename = std::string())
+{
+  typedef detail::snapshot_registry registry_type;
+
+  registry_type &registry = registry_type::instance();
+
+  detail::snapshot_header header =
+    detail::read_snapshot_header(data,size,sizeof(CharT),filename);
+
+  basic_variable_map<CharT> vm;
+  std::basic_string<CharT> key;
+  registry_type::serializer_ptr ser;
+
+  for(std::size_t n=0; n<header.count; ++n) {
+    detail::snapshot_entry entry =
+      detail::read_snapshot_entry(data,size,n,sizeof(CharT),filename);
+
+    key.resize(entry.key_length);
+    if(entry.key_length) {
+      std::memcpy(&key[0],data+entry.key_offset,
+        entry.key_length*sizeof(CharT));
+    }
+
+    any val;
+    if(entry.tag != snapshot_empty) {
+      // consecutive values are often of the same type
+      if(!ser || ser->tag != entry.tag)
+        ser = registry.find(entry.tag);
+      if(!ser)
+        throw snapshot_error(filename,"unknown snapshot tag");
+
+      try {
+        val = ser->load(detail::snapshot_value(data,entry),
+          static_cast<std::size_t>(entry.value_length));
+      }
+      catch(...) {
+        std::throw_with_nested(snapshot_error(filename,"invalid value"));
+      }
+    }
+
+    // entries are in key order
+    vm.emplace_hint(vm.end(),key,std::move(val));
+  }
+
+  return vm;
+}
+
+/*
+  Write the snapshot of \c vm to \c filename. An existing file is
+  replaced rather than rewritten so that programs that have it loaded are
+  not affected.
+*/
+template<typename CharT>
+void save_snapshot(const std::string &filename,
+  const basic_variable_map<CharT> &vm)
+{
+  detail::replace_snapshot_file(filename,make_snapshot(vm,filename));
+}
+
+/*
+  Read the snapshot in \c filename as written by save_snapshot. The file
+  is mapped and read in place.
+*/
+template<typename CharT = char>
+basic_variable_map<CharT> load_snapshot(const std::string &filename)
+{
+  detail::mapped_snapshot file = detail::map_snapshot(filename);
+
+  return read_snapshot<CharT>(file.data,file.size,filename);
+}
+
+}
+
+#endif
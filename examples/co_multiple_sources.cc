@@ -26,9 +26,9 @@
  */
 
 #include "cmd_options.h"
+#include "cmd_options/config_file.h"
 
 #include <iostream>
-#include <fstream>
 
 int main (int argc, char *argv[])
 {
@@ -75,21 +75,15 @@ int main (int argc, char *argv[])
         << *res << "'\n";
     }
 
-    std::ifstream ifs(config_file.c_str());
-    if(!ifs) {
-      std::cout << "can not open config file: " << config_file << "\n";
-      return 0;
+    try {
+      vm = co::parse_config_file(config_file,config,vm);
     }
-    else {
-      // no config parsing functionality as part of cmd_options. Use a simple
-      // config file scheme that simply pulls in args delimited by whitespace
-      std::string arg;
-      std::vector<std::string> config_vec;
-      while((ifs >> arg))
-        config_vec.push_back(arg);
-
-      std::tie(std::ignore,vm) =
-        co::parse_arguments(config_vec.begin(),config_vec.end(),config,vm);
+    catch(const co::config_file_error &ex) {
+      if(ex.line() == 0) {
+        std::cout << "can not open config file: " << config_file << "\n";
+        return 0;
+      }
+      throw;
     }
 
     if (vm.count("help")) {
@@ -0,0 +1,122 @@
+/**
+ *  Copyright (c) 2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+  Scaling benchmark for parse_batch. Parses the same batch of generated
+  command lines against one shared options group using 1 to 64 threads
+  and reports the time taken and the speedup over a single thread.
+
+  usage: parse_batch_bench [number of command lines] [repetitions]
+*/
+
+#include "cmd_options.h"
+#include "cmd_options/parallel.h"
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+namespace co = cmd_options;
+
+int main (int argc, char *argv[])
+{
+  std::size_t batch_size = (argc > 1 ? std::strtoul(argv[1],0,10) : 20000);
+  std::size_t repetitions = (argc > 2 ? std::strtoul(argv[2],0,10) : 3);
+
+  const co::options_group grp{
+    co::make_option("help,h","Display a help message",
+      co::constrain().preempt()),
+    co::make_option("verbose,v","Be chatty"),
+    co::make_option("all,a","Process everything",
+      co::constrain().occurrences(0,1)),
+    co::make_option("jobs,j",co::value<int>().implicit(1),
+      "Number of concurrent jobs",co::constrain().occurrences(0,1)),
+    co::make_option("output,o",co::value<std::string>(),
+      "Output location",co::constrain().occurrences(0,1)),
+    co::make_option("define,D",co::value<std::string>(),"Define a macro"),
+    co::make_option("level",co::value<double>(),"Compression level"),
+    co::make_operand("input",co::value<std::string>(),
+      co::constrain().occurrences(1,std::numeric_limits<std::size_t>::max()))
+  };
+
+  // a mix of short, packed, and long options with several operands
+  std::vector<std::vector<std::string> > batch;
+  batch.reserve(batch_size);
+  for(std::size_t i=0; i<batch_size; ++i) {
+    std::string n = std::to_string(i);
+
+    std::vector<std::string> args{"-va","--jobs="+std::to_string(i%16+1),
+      "-o","out"+n+".bin","-DNAME"+n,"--level",std::to_string(i%10*0.5)};
+
+    for(std::size_t j=0; j<i%8+1; ++j)
+      args.push_back("input_"+n+"_"+std::to_string(j)+".dat");
+
+    batch.push_back(std::move(args));
+  }
+
+  std::cout << "parsing " << batch_size << " command lines, best of "
+    << repetitions << "\n\n"
+    << std::setw(8) << "threads" << std::setw(12) << "time (ms)"
+    << std::setw(14) << "lines/sec" << std::setw(10) << "speedup" << "\n";
+
+  double baseline = 0;
+  for(std::size_t nthreads = 1; nthreads <= 64; nthreads *= 2) {
+    co::thread_pool executor(nthreads);
+
+    double best = 0;
+    for(std::size_t rep=0; rep<repetitions; ++rep) {
+      auto start = std::chrono::steady_clock::now();
+
+      std::vector<co::batch_result> results =
+        co::parse_batch(batch.begin(),batch.end(),grp,executor);
+
+      std::chrono::duration<double,std::milli> elapsed =
+        std::chrono::steady_clock::now()-start;
+
+      for(auto &result : results) {
+        if(result.failed())
+          std::rethrow_exception(result.error);
+      }
+
+      if(rep == 0 || elapsed.count() < best)
+        best = elapsed.count();
+    }
+
+    if(nthreads == 1)
+      baseline = best;
+
+    std::cout << std::setw(8) << nthreads
+      << std::setw(12) << std::fixed << std::setprecision(2) << best
+      << std::setw(14) << std::setprecision(0) << (batch_size/(best/1000.0))
+      << std::setw(10) << std::setprecision(2) << (baseline/best) << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,68 @@
+/**
+ *  Copyright (c) 2018, Mike Tegtmeyer
+ *  All rights reserved.
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the author nor the names of its contributors may
+ *        be used to endorse or promote products derived from this software
+ *        without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ *  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+ *  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ *  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ *  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ *  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+  Print help text that was generated at build time. The default width is
+  typeset once by static_help_gen and embedded as a string literal so
+  `--help` does no formatting at all. Other widths given by `--width` are
+  typeset at runtime.
+*/
+
+#include "cmd_options.h"
+
+#include "static_help_options.h"
+#include "static_help_text.h"
+
+#include <iostream>
+
+int main (int argc, char *argv[])
+{
+  namespace co = cmd_options;
+
+  co::options_group grp = static_help_options();
+
+  char **res = 0;
+  co::variable_map vm;
+  std::tie(res,vm) = co::parse_arguments(argv+1,argv+argc,grp);
+
+  if(vm.count("width")) {
+    co::basic_default_formatter<char> fmt;
+    fmt.max_width(co::any_cast<std::size_t>(vm.find("width")->second));
+    std::cout << co::to_string(grp,fmt);
+    return 0;
+  }
+
+  if(vm.count("help")) {
+    std::cout << static_help_text;
+    return 0;
+  }
+
+  if(vm.count("verbose"))
+    std::cerr << "Nothing to do\n";
+
+  return 0;
+}
@@ -283,14 +283,12 @@ BOOST_AUTO_TEST_CASE( unpack_posix_flag_test )
   // packed flags
   BOOST_REQUIRE(
     (co::unpack_posix<true,detail::check_char_t>(_LIT("-fbar")) ==
-    option_pack(true,false,_LIT("f"),{_LIT("-b"),_LIT("-a"),_LIT("-r")})));
+    option_pack(true,false,_LIT("f"),{},{},_LIT("bar"))));
 
   // packed flag with trailing extra
   BOOST_REQUIRE(
     (co::unpack_posix<true,detail::check_char_t>(_LIT("-f bar")) ==
-    option_pack(true,false,_LIT("f"),
-      {_LIT("- "),_LIT("-b"),_LIT("-a"),
-        _LIT("-r")})));
+    option_pack(true,false,_LIT("f"),{},{},_LIT(" bar"))));
 
   // cease flag
   BOOST_REQUIRE(
@@ -300,14 +298,12 @@ BOOST_AUTO_TEST_CASE( unpack_posix_flag_test )
   // cease flag with extra chars
   BOOST_REQUIRE(
     (co::unpack_posix<true,detail::check_char_t>(_LIT("--blah")) ==
-    option_pack(true,false,_LIT("-"),{_LIT("-b"),_LIT("-l"),_LIT("-a"),
-        _LIT("-h")})));
+    option_pack(true,false,_LIT("-"),{},{},_LIT("blah"))));
 
   // packed with embedded 'end of options'
   BOOST_REQUIRE(
     (co::unpack_posix<true,detail::check_char_t>(_LIT("-fb--ar")) ==
-    option_pack(true,false,_LIT("f"),{_LIT("-b"),_LIT("--"),_LIT("--"),
-      _LIT("-a"),_LIT("-r")})));
+    option_pack(true,false,_LIT("f"),{},{},_LIT("b--ar"))));
 }
 
 /**
@@ -374,13 +370,12 @@ BOOST_AUTO_TEST_CASE( unpack_gnu_flag_test )
   // packed flags
   BOOST_REQUIRE(
     (co::unpack_gnu<true,detail::check_char_t>(_LIT("-fbar")) ==
-    option_pack(true,false,_LIT("f"),{_LIT("-b"),_LIT("-a"),_LIT("-r")})));
+    option_pack(true,false,_LIT("f"),{},{},_LIT("bar"))));
 
   // packed flag with trailing extra
   BOOST_REQUIRE(
     (co::unpack_gnu<true,detail::check_char_t>(_LIT("-f bar")) ==
-    option_pack(true,false,_LIT("f"),{_LIT("- "),_LIT("-b"),_LIT("-a"),
-        _LIT("-r")})));
+    option_pack(true,false,_LIT("f"),{},{},_LIT(" bar"))));
 
   // cease flag
   BOOST_REQUIRE(
@@ -5,6 +5,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <iostream>
+#include <list>
 
 /**
   case 14, operand
@@ -107,5 +108,122 @@ BOOST_AUTO_TEST_CASE( key_value_with_embedded_operand_test )
 
 
 
+/**
+  lazy operands are stored by location and converted when visited
+ */
+BOOST_AUTO_TEST_CASE( lazy_operand_test )
+{
+  variable_map_type vm;
+  options_group_type options;
+  std::vector<const detail::check_char_t *> argv{
+    _LIT("operand1"),
+    _LIT("operand2"),
+    _LIT("-f"),
+    _LIT("f_arg"),
+    _LIT("operand3"),
+    _LIT("--"),
+    _LIT("operand4"),
+    _LIT("-f"),
+  };
+
+  options = options_group_type{
+    co::make_option(_LIT("foo,f"),
+      co::basic_value<string_type,detail::check_char_t>(),_LIT("case 14")),
+    co::make_operand(_LIT("key"),
+      co::basic_value<string_type,detail::check_char_t>(),
+      co::basic_constraint<detail::check_char_t>().occurrences(5).lazy())
+  };
+
+  std::tie(std::ignore,vm) =
+    co::parse_arguments(argv.data(),argv.data()+argv.size(),options);
+
+  // the option and the end of options each break the operands into a new
+  // range
+  BOOST_REQUIRE(vm.count(_LIT("key")) == 3);
+  BOOST_REQUIRE(co::count_values(string_type(_LIT("key")),vm) == 5);
+
+  std::vector<string_type> operands;
+  co::for_each_value<string_type>(_LIT("key"),vm,
+    [&](const string_type &val) { operands.push_back(val); });
+
+  BOOST_REQUIRE(operands == (std::vector<string_type>{
+    _LIT("operand1"),
+    _LIT("operand2"),
+    _LIT("operand3"),
+    _LIT("operand4"),
+    _LIT("-f"),
+  }));
+}
+
+/**
+  lazy operands can be read back from a range that is not random access
+ */
+BOOST_AUTO_TEST_CASE( lazy_operand_list_test )
+{
+  variable_map_type vm;
+  options_group_type options;
+  std::list<const detail::check_char_t *> args{
+    _LIT("operand1"),
+    _LIT("operand2"),
+    _LIT("-f"),
+    _LIT("f_arg"),
+    _LIT("operand3"),
+  };
+
+  options = options_group_type{
+    co::make_option(_LIT("foo,f"),
+      co::basic_value<string_type,detail::check_char_t>(),_LIT("case 14")),
+    co::make_operand(_LIT("key"),
+      co::basic_value<string_type,detail::check_char_t>(),
+      co::basic_constraint<detail::check_char_t>().lazy())
+  };
+
+  std::tie(std::ignore,vm) =
+    co::parse_arguments(args.begin(),args.end(),options);
+
+  BOOST_REQUIRE(vm.count(_LIT("key")) == 2);
+
+  std::vector<string_type> operands;
+  co::for_each_value<string_type>(_LIT("key"),vm,
+    [&](const string_type &val) { operands.push_back(val); });
+
+  BOOST_REQUIRE(operands == (std::vector<string_type>{
+    _LIT("operand1"),
+    _LIT("operand2"),
+    _LIT("operand3"),
+  }));
+}
+
+/**
+  lazy operand conversion errors are reported when visited
+ */
+BOOST_AUTO_TEST_CASE( lazy_operand_conversion_test )
+{
+  variable_map_type vm;
+  options_group_type options;
+  std::vector<const detail::check_char_t *> argv{
+    _LIT("1"),
+    _LIT("2"),
+    _LIT("three"),
+  };
+
+  options = options_group_type{
+    co::make_operand(_LIT("key"),co::basic_value<int,detail::check_char_t>(),
+      co::basic_constraint<detail::check_char_t>().lazy())
+  };
+
+  std::tie(std::ignore,vm) =
+    co::parse_arguments(argv.data(),argv.data()+argv.size(),options);
+
+  BOOST_REQUIRE(vm.count(_LIT("key")) == 1);
+
+  int sum = 0;
+  BOOST_REQUIRE_THROW(
+    co::for_each_value<int>(_LIT("key"),vm,[&](int val) { sum += val; }),
+    co::invalid_argument_error);
+  BOOST_REQUIRE(sum == 3);
+}
+
+
 BOOST_AUTO_TEST_SUITE_END()
 
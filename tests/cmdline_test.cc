@@ -0,0 +1,122 @@
+#include "cmd_options.h"
+#include "cmd_options/cmdline.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+/**
+  NUL separated argument range test
+ */
+
+BOOST_AUTO_TEST_SUITE( cmdline_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::vector<std::string> args_type;
+
+/**
+  Iterate in both directions with and without a terminated last argument
+ */
+BOOST_AUTO_TEST_CASE( cmdline_iterator_test )
+{
+  const char cmdline[] = "prog\0-f\0\0--bar";
+  const std::string terminated(cmdline,sizeof(cmdline));
+  const std::string unterminated(cmdline,sizeof(cmdline)-1);
+
+  for(auto &buffer : {terminated,unterminated}) {
+    co::cmdline_arguments args(buffer.data(),buffer.data()+buffer.size());
+
+    BOOST_REQUIRE(args_type(args.begin(),args.end()) ==
+      (args_type{"prog","-f","","--bar"}));
+
+    args_type reversed;
+    for(auto cur = args.end(); cur != args.begin();)
+      reversed.push_back(*--cur);
+    BOOST_REQUIRE(reversed == (args_type{"--bar","","-f","prog"}));
+
+    BOOST_REQUIRE(std::distance(args.begin(),args.end()) == 4);
+  }
+
+  co::cmdline_arguments empty(terminated.data(),terminated.data());
+  BOOST_REQUIRE(empty.empty() && empty.begin() == empty.end());
+}
+
+/**
+  Iterators remain valid when the arguments are moved
+ */
+BOOST_AUTO_TEST_CASE( cmdline_move_test )
+{
+  const char cmdline[] = "prog\0-f\0--bar";
+  const std::string buffer(cmdline,sizeof(cmdline)-1);
+
+  co::cmdline_arguments args(buffer.data(),buffer.data()+buffer.size());
+  co::cmdline_arguments::const_iterator first = args.begin();
+  co::cmdline_arguments::const_iterator last = args.end();
+
+  co::cmdline_arguments moved(std::move(args));
+  BOOST_REQUIRE(args.empty() && args.begin() == args.end());
+
+  // the unterminated last argument is read from its copy
+  args = co::cmdline_arguments(buffer.data(),buffer.data());
+  BOOST_REQUIRE(args_type(first,last) == (args_type{"prog","-f","--bar"}));
+  BOOST_REQUIRE(first == moved.begin() && last == moved.end());
+
+  args_type reversed;
+  for(auto cur = last; cur != first;)
+    reversed.push_back(*--cur);
+  BOOST_REQUIRE(reversed == (args_type{"--bar","-f","prog"}));
+}
+
+/**
+  The buffer is parsed in place including lazy operands
+ */
+BOOST_AUTO_TEST_CASE( cmdline_parse_test )
+{
+  const char cmdline[] = "prog\0-f\0""1\0op1\0--\0op2";
+  const std::string buffer(cmdline,sizeof(cmdline)-1);
+  co::cmdline_arguments args(buffer.data(),buffer.data()+buffer.size());
+
+  co::options_group grp{
+    co::make_option("foo,f",co::value<int>(),"case 3"),
+    co::make_operand("operand",co::value<std::string>(),
+      co::constrain().lazy())
+  };
+
+  co::variable_map vm;
+  std::tie(std::ignore,vm) =
+    co::parse_arguments(std::next(args.begin()),args.end(),grp);
+
+  BOOST_REQUIRE(vm.size() == 3);
+  BOOST_REQUIRE(co::any_cast<int>(vm.find("foo")->second) == 1);
+
+  args_type operands;
+  auto &&range = vm.equal_range("operand");
+  for(auto cur = range.first; cur != range.second; ++cur) {
+    auto &&operand_range = co::any_cast<co::operand_range>(cur->second);
+    for(std::size_t i=0; i<operand_range.size(); ++i)
+      operands.push_back(operand_range.argument(i));
+  }
+  BOOST_REQUIRE(operands == (args_type{"op1","op2"}));
+}
+
+#ifdef __linux__
+/**
+  The arguments of this process can be read back
+ */
+BOOST_AUTO_TEST_CASE( cmdline_self_test )
+{
+  co::cmdline_arguments args = co::cmdline_arguments::from_self();
+  BOOST_REQUIRE(!args.empty());
+
+  co::cmdline_arguments other = co::cmdline_arguments::from_process(getpid());
+  BOOST_REQUIRE(args_type(args.begin(),args.end()) ==
+    args_type(other.begin(),other.end()));
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
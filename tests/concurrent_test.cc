@@ -0,0 +1,226 @@
+#include "cmd_options.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+#include <atomic>
+
+/**
+  Concurrent parsing stress test. The scenarios here are copies of a few
+  representative case tests and are parsed from several threads at once
+  using a single shared options group per scenario. Each result is
+  compared to the result of parsing the same scenario on one thread.
+
+  The case test bodies are not run from the threads themselves. Their
+  BOOST_REQUIRE checks are not thread safe in Boost.Test, which records
+  results and aborts test cases from the main thread only, and each case
+  test is built as a program of its own whose helpers share names with
+  the others. Instead, each thread only parses and renders, and the
+  results are compared on the main thread. Changes to the case tests are
+  therefore not picked up here; add a scenario below for new behavior
+  that should be checked under concurrency. Build with
+  `configure --enable-tsan` to run this under ThreadSanitizer.
+ */
+
+BOOST_AUTO_TEST_SUITE( concurrent_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::basic_string<detail::check_char_t> string_type;
+typedef co::basic_options_group<detail::check_char_t> options_group_type;
+typedef co::basic_variable_map<detail::check_char_t> variable_map_type;
+typedef co::basic_operand_range<detail::check_char_t> operand_range_type;
+typedef std::vector<const detail::check_char_t *> argv_type;
+
+struct scenario {
+  options_group_type grp;
+  argv_type argv;
+};
+
+const std::size_t num_threads = 8;
+const std::size_t num_iterations = 200;
+
+/*
+  Render a value for comparison. Only handles the types used below.
+*/
+string_type describe(const co::any &val)
+{
+  std::basic_stringstream<detail::check_char_t> out;
+
+  if(co::is_empty(val))
+    out << _LIT("(empty)");
+  else if(val.type() == typeid(int))
+    out << _LIT("int:") << co::any_cast<int>(val);
+  else if(val.type() == typeid(string_type))
+    out << _LIT("string:") << co::any_cast<string_type>(val);
+  else if(val.type() == typeid(operand_range_type)) {
+    const operand_range_type &range = co::any_cast<operand_range_type>(val);
+    out << _LIT("range:");
+    for(std::size_t i=0; i<range.size(); ++i)
+      out << range.argument(i) << _LIT(";");
+  }
+  else
+    out << _LIT("unknown");
+
+  return out.str();
+}
+
+/*
+  Parse the scenario and render the result or the exception thrown
+*/
+string_type run(const scenario &scn)
+{
+  std::basic_stringstream<detail::check_char_t> out;
+
+  try {
+    const detail::check_char_t * const *res;
+    variable_map_type vm;
+    std::tie(res,vm) =
+      co::parse_arguments(scn.argv.data(),scn.argv.data()+scn.argv.size(),
+        scn.grp);
+
+    out << (res - scn.argv.data()) << _LIT("|");
+    for(auto &entry : vm)
+      out << entry.first << _LIT("=") << describe(entry.second) << _LIT("|");
+  }
+  catch(const std::exception &ex) {
+    out << _LIT("exception:") << typeid(ex).name();
+  }
+
+  return out.str();
+}
+
+std::vector<scenario> scenarios(int *bound)
+{
+  std::vector<scenario> result;
+
+  // case 2: flags with packing and constraints
+  result.push_back(scenario{
+    options_group_type{
+      co::make_option(_LIT("foo,f"),_LIT("case 2")),
+      co::make_option(_LIT("bar,b"),_LIT("case 2"),
+        co::basic_constraint<detail::check_char_t>().occurrences(0,1))
+    },
+    argv_type{_LIT("-fb"),_LIT("--foo"),_LIT("-ff")}
+  });
+
+  // case 2: constraint violation
+  result.push_back(scenario{
+    result.back().grp,
+    argv_type{_LIT("-bb")}
+  });
+
+  // case 3 and 14: values, implicit values, and operands
+  result.push_back(scenario{
+    options_group_type{
+      co::make_option(_LIT("foo,f"),
+        co::basic_value<string_type,detail::check_char_t>(),
+        _LIT("case 14")),
+      co::make_option(_LIT("bar,b"),
+        co::basic_value<string_type,detail::check_char_t>()
+          .implicit(_LIT("blar")),
+        _LIT("case 14")),
+      co::make_option(_LIT("num,n"),
+        co::basic_value<int,detail::check_char_t>(bound),_LIT("case 3")),
+      co::make_operand(_LIT("key"),
+        co::basic_value<string_type,detail::check_char_t>())
+    },
+    argv_type{_LIT("-f"),_LIT("f_arg"),_LIT("operand1"),_LIT("-f42"),
+      _LIT("--bar"),_LIT("operand2"),_LIT("--bar=43"),_LIT("-n7"),
+      _LIT("--"),_LIT("-operand3")}
+  });
+
+  // case 3: invalid value
+  result.push_back(scenario{
+    result.back().grp,
+    argv_type{_LIT("--num"),_LIT("seven")}
+  });
+
+  // case 14: lazy operands
+  result.push_back(scenario{
+    options_group_type{
+      co::make_option(_LIT("foo,f"),_LIT("case 2")),
+      co::make_operand(_LIT("key"),
+        co::basic_value<int,detail::check_char_t>(),
+        co::basic_constraint<detail::check_char_t>().lazy())
+    },
+    argv_type{_LIT("1"),_LIT("2"),_LIT("-f"),_LIT("3"),_LIT("4")}
+  });
+
+  // unknown option
+  result.push_back(scenario{
+    result.back().grp,
+    argv_type{_LIT("--unknown")}
+  });
+
+  return result;
+}
+
+/**
+  Parse the same groups concurrently
+ */
+BOOST_AUTO_TEST_CASE( concurrent_parse_test )
+{
+  int bound = 0;
+  const std::vector<scenario> scns = scenarios(&bound);
+
+  std::vector<string_type> expected;
+  for(auto &scn : scns)
+    expected.push_back(run(scn));
+
+  std::atomic<std::size_t> mismatches(0);
+
+  std::vector<std::thread> threads;
+  for(std::size_t i=0; i<num_threads; ++i) {
+    threads.emplace_back([&](void) {
+      for(std::size_t n=0; n<num_iterations; ++n) {
+        for(std::size_t j=0; j<scns.size(); ++j) {
+          if(run(scns[j]) != expected[j])
+            ++mismatches;
+        }
+      }
+    });
+  }
+
+  for(auto &thread : threads)
+    thread.join();
+
+  BOOST_REQUIRE(mismatches == 0);
+  BOOST_REQUIRE(bound == 7);
+}
+
+/**
+  Generate help text for the same group concurrently
+ */
+BOOST_AUTO_TEST_CASE( concurrent_help_test )
+{
+  int bound = 0;
+  const std::vector<scenario> scns = scenarios(&bound);
+
+  std::vector<string_type> expected;
+  for(auto &scn : scns)
+    expected.push_back(co::to_string(scn.grp));
+
+  std::atomic<std::size_t> mismatches(0);
+
+  std::vector<std::thread> threads;
+  for(std::size_t i=0; i<num_threads; ++i) {
+    threads.emplace_back([&](void) {
+      for(std::size_t n=0; n<num_iterations/10; ++n) {
+        for(std::size_t j=0; j<scns.size(); ++j) {
+          if(co::to_string(scns[j].grp) != expected[j])
+            ++mismatches;
+        }
+      }
+    });
+  }
+
+  for(auto &thread : threads)
+    thread.join();
+
+  BOOST_REQUIRE(mismatches == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
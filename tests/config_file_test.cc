@@ -0,0 +1,110 @@
+#include "cmd_options.h"
+#include "cmd_options/config_file.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+/**
+  configuration file test
+ */
+
+BOOST_AUTO_TEST_SUITE( config_file_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::basic_string<detail::check_char_t> string_type;
+typedef co::basic_options_group<detail::check_char_t> options_group_type;
+typedef co::basic_variable_map<detail::check_char_t> variable_map_type;
+typedef std::basic_istringstream<detail::check_char_t> istream_type;
+
+options_group_type config_group(void)
+{
+  return options_group_type{
+    co::make_option(_LIT("foo,f"),co::basic_value<int,detail::check_char_t>(),
+      _LIT("case 3")),
+    co::make_option(_LIT("bar,b"),_LIT("case 2"),
+      co::basic_constraint<detail::check_char_t>().occurrences(0,1)),
+    co::make_option(_LIT("server.name"),
+      co::basic_value<string_type,detail::check_char_t>()
+        .implicit(_LIT("localhost")),
+      _LIT("case 14"))
+  };
+}
+
+/**
+  Entries are handled by the option descriptions
+ */
+BOOST_AUTO_TEST_CASE( config_file_entry_test )
+{
+  istream_type in(
+    _LIT("# comment\n")
+    _LIT("  foo = 42  \n")
+    _LIT("\n")
+    _LIT("; another comment\n")
+    _LIT("b\n")
+    _LIT("[ server ]\n")
+    _LIT("name = \" quoted = value \"\n")
+    _LIT("name\n")
+    _LIT("[]\n")
+    _LIT("f=7"));
+
+  variable_map_type vm = co::parse_config(in,config_group());
+
+  BOOST_REQUIRE(detail::vm_check(vm,{
+    detail::check_empty(string_type(_LIT("bar"))),
+    detail::check_value(_LIT("foo"),42),
+    detail::check_value(_LIT("foo"),7),
+    detail::check_value(_LIT("server.name"),
+      string_type(_LIT(" quoted = value "))),
+    detail::check_value(_LIT("server.name"),string_type(_LIT("localhost")))
+  }));
+}
+
+/*
+  The line number of the config_file_error thrown for text. The nested
+  exception must be an E.
+*/
+template<typename E>
+std::size_t error_line(const string_type &text)
+{
+  istream_type in(text);
+  try {
+    co::parse_config(in,config_group(),variable_map_type(),"test.cfg");
+  }
+  catch(const co::config_file_error &ex) {
+    BOOST_REQUIRE(std::string(ex.filename()) == "test.cfg");
+    BOOST_REQUIRE_THROW(std::rethrow_if_nested(ex),E);
+
+    return ex.line();
+  }
+
+  return 0;
+}
+
+/**
+  Errors are reported with the line number and nest the original error
+ */
+BOOST_AUTO_TEST_CASE( config_file_error_test )
+{
+  BOOST_REQUIRE(error_line<co::unknown_option_error>(
+    _LIT("foo=1\n\nunknown=2\n")) == 3);
+  BOOST_REQUIRE(error_line<co::invalid_argument_error>(
+    _LIT("foo=one\n")) == 1);
+  BOOST_REQUIRE(error_line<co::missing_argument_error>(
+    _LIT("foo\n")) == 1);
+  BOOST_REQUIRE(error_line<co::unexpected_argument_error>(
+    _LIT("#\nbar=1\n")) == 2);
+  BOOST_REQUIRE(error_line<std::runtime_error>(
+    _LIT("[server\n")) == 1);
+
+  // constraints apply to the whole file
+  istream_type in(_LIT("bar\nbar\n"));
+  BOOST_REQUIRE_THROW(co::parse_config(in,config_group()),
+    co::occurrence_error);
+
+  BOOST_REQUIRE_THROW(co::parse_config_file("config_file_test_missing.cfg",
+    config_group()),co::config_file_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
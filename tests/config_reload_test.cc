@@ -0,0 +1,209 @@
+#include "cmd_options.h"
+#include "cmd_options/config_reload.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <fstream>
+
+/**
+  configuration reload test
+ */
+
+BOOST_AUTO_TEST_SUITE( config_reload_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::vector<std::string> keys_type;
+
+/*
+  Write a configuration file that is removed at the end of the test
+*/
+struct scoped_file {
+  scoped_file(const std::string &_name, const std::string &contents)
+    :name(_name)
+  {
+    write(contents);
+  }
+
+  ~scoped_file(void) {
+    std::remove(name.c_str());
+  }
+
+  void write(const std::string &contents) {
+    std::ofstream out(name.c_str(),std::ios::binary);
+    out << contents;
+  }
+
+  std::string name;
+};
+
+/*
+  Options that count their conversions and finalize calls
+*/
+struct counted_group {
+  counted_group(void) :conversions(0) {
+    grp.push_back(co::make_option("foo",co::value<int>()
+      .validate([this](const int &) { ++conversions; }),"foo"));
+    grp.push_back(co::make_option("bar",co::value<int>()
+      .validate([this](const int &) { ++conversions; }),"bar"));
+    grp.push_back(co::make_option("qux","qux"));
+    grp.push_back(co::make_option("sec.baz",co::value<std::string>(),
+      "sec.baz"));
+
+    for(auto &desc : grp) {
+      std::string name = desc.key_description ? desc.key_description() : "";
+      auto finalize = desc.finalize;
+      desc.finalize = [this,name,finalize](const co::variable_map &vm) {
+        ++finalized[name];
+        if(finalize)
+          finalize(vm);
+      };
+    }
+  }
+
+  co::options_group grp;
+  std::size_t conversions;
+  std::map<std::string,std::size_t> finalized;
+};
+
+/**
+  Only changed entries are converted again and only their descriptions
+  are finalized
+ */
+BOOST_AUTO_TEST_CASE( config_reload_diff_test )
+{
+  counted_group counted;
+  scoped_file file("config_reload_test_diff.cfg",
+    "foo = 1\nbar = 2\n[sec]\nbaz = \"x y\"\n");
+
+  co::config_reloader config(file.name,counted.grp);
+
+  BOOST_REQUIRE(detail::vm_check(config.variables(),{
+    detail::check_value("bar",2),
+    detail::check_value("foo",1),
+    detail::check_value("sec.baz",std::string("x y"))
+  }));
+  BOOST_REQUIRE(counted.conversions == 2);
+  BOOST_REQUIRE(counted.finalized.size() == 4);
+
+  file.write("# comment\nfoo = 1\nbar = 3\nqux\n");
+  counted.conversions = 0;
+  counted.finalized.clear();
+
+  co::config_reloader::diff_type diff = config.reload();
+
+  BOOST_REQUIRE(diff.added == keys_type{"qux"});
+  BOOST_REQUIRE(diff.removed == keys_type{"sec.baz"});
+  BOOST_REQUIRE(diff.changed == keys_type{"bar"});
+  BOOST_REQUIRE(counted.conversions == 1);
+  BOOST_REQUIRE(counted.finalized.size() == 3);
+  for(auto &elem : counted.finalized)
+    BOOST_REQUIRE(elem.first.compare(0,5,"--foo") != 0);
+
+  BOOST_REQUIRE(detail::vm_check(config.variables(),{
+    detail::check_value("bar",3),
+    detail::check_value("foo",1),
+    detail::check_empty(std::string("qux"))
+  }));
+
+  counted.conversions = 0;
+  counted.finalized.clear();
+
+  BOOST_REQUIRE(config.reload().empty());
+  BOOST_REQUIRE(counted.conversions == 0 && counted.finalized.empty());
+}
+
+/**
+  Constraints between options are checked again when only one of them
+  changed
+ */
+BOOST_AUTO_TEST_CASE( config_reload_constraint_test )
+{
+  co::options_group grp{
+    co::make_option("alpha","alpha",
+      co::constrain().mutually_inclusive({"beta"})),
+    co::make_option("beta","beta")
+  };
+  scoped_file file("config_reload_test_constraint.cfg","alpha\nbeta\n");
+
+  co::config_reloader config(file.name,grp);
+
+  file.write("alpha\n");
+  BOOST_REQUIRE_THROW(config.reload(),co::mutually_inclusive_error);
+  BOOST_REQUIRE(detail::vm_check(config.variables(),{
+    detail::check_empty(std::string("alpha")),
+    detail::check_empty(std::string("beta"))
+  }));
+
+  file.write("beta\n");
+  co::variable_map_diff diff = config.reload();
+  BOOST_REQUIRE(diff.removed == keys_type{"alpha"});
+  BOOST_REQUIRE(detail::vm_check(config.variables(),{
+    detail::check_empty(std::string("beta"))
+  }));
+}
+
+/**
+  A failed reload keeps the previous variables
+ */
+BOOST_AUTO_TEST_CASE( config_reload_error_test )
+{
+  counted_group counted;
+  scoped_file file("config_reload_test_error.cfg","foo = 1\n");
+
+  co::config_reloader config(file.name,counted.grp);
+
+  file.write("foo = 2\nunknown = 1\n");
+  try {
+    config.reload();
+    BOOST_FAIL("expected config_file_error");
+  }
+  catch(const co::config_file_error &ex) {
+    BOOST_REQUIRE(ex.line() == 2);
+  }
+
+  BOOST_REQUIRE(detail::vm_check(config.variables(),{
+    detail::check_value("foo",1)
+  }));
+
+  file.write("foo = 2\n");
+  co::config_reloader::diff_type diff = config.reload();
+  BOOST_REQUIRE(diff.changed == keys_type{"foo"});
+  BOOST_REQUIRE(detail::vm_check(config.variables(),{
+    detail::check_value("foo",2)
+  }));
+}
+
+#ifdef CMD_OPTIONS_HAVE_INOTIFY
+/**
+  A watched file is reloaded only after it is written
+ */
+BOOST_AUTO_TEST_CASE( config_reload_watch_test )
+{
+  counted_group counted;
+  scoped_file file("config_reload_test_watch.cfg","foo = 1\n");
+
+  co::config_reloader config(file.name,counted.grp);
+  BOOST_REQUIRE(config.fd() == -1);
+
+  config.watch();
+  BOOST_REQUIRE(config.fd() != -1);
+  BOOST_REQUIRE(!config.pending());
+
+  counted.conversions = 0;
+  BOOST_REQUIRE(config.update().empty());
+  BOOST_REQUIRE(counted.conversions == 0);
+
+  file.write("foo = 2\n");
+
+  co::config_reloader::diff_type diff = config.update();
+  BOOST_REQUIRE(diff.changed == keys_type{"foo"});
+  BOOST_REQUIRE(counted.conversions == 1);
+  BOOST_REQUIRE(!config.pending());
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,158 @@
+#include "cmd_options.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+/**
+  variable map diff test
+ */
+
+/*
+  A user type that compares by the case-insensitive first letter
+*/
+struct initial {
+  char letter;
+};
+
+namespace cmd_options {
+
+template<>
+struct compare_value<initial> {
+  static bool equal(const initial &lhs, const initial &rhs)
+  {
+    return (lhs.letter|0x20) == (rhs.letter|0x20);
+  }
+};
+
+}
+
+/*
+  A user type without operator==
+*/
+struct opaque {
+  int val;
+};
+
+/*
+  A user type without operator== used in a container whose operator== is
+  declared but cannot be instantiated
+*/
+struct point {
+  int x;
+};
+
+namespace cmd_options {
+
+template<>
+struct convert_value<std::vector<point> > {
+  static std::vector<point> from_string(const std::string &str)
+  {
+    return std::vector<point>(1,point{convert_value<int>::from_string(str)});
+  }
+
+  static void to_string(std::string &str, const std::vector<point> &val)
+  {
+    convert_value<std::size_t>::to_string(str,val.size());
+  }
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE( diff_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::vector<std::string> keys_type;
+typedef std::vector<const char *> argv_type;
+
+co::variable_map parse(const co::options_group &grp, const argv_type &argv)
+{
+  return co::parse_arguments(argv.data(),argv.data()+argv.size(),grp).second;
+}
+
+/**
+  Parsed values are compared by value rather than by argument text
+ */
+BOOST_AUTO_TEST_CASE( parsed_diff_test )
+{
+  co::options_group grp{
+    co::make_option("foo",co::value<int>(),"foo"),
+    co::make_option("bar",co::value<std::string>(),"bar"),
+    co::make_option("baz","baz"),
+    co::make_option("list",co::value<int>(),"list"),
+    co::make_option("qux",co::value<double>(),"qux")
+  };
+
+  co::variable_map vm_old = parse(grp,{"--foo","01","--bar","x","--baz",
+    "--list","1","--list","2","--qux","1.5"});
+  co::variable_map vm_new = parse(grp,{"--foo","1","--list","1",
+    "--list","2","--list","3","--qux","1.50","--baz"});
+
+  co::variable_map_diff diff = co::diff(vm_old,vm_new);
+  BOOST_REQUIRE(diff.added.empty());
+  BOOST_REQUIRE(diff.removed == keys_type{"bar"});
+  BOOST_REQUIRE(diff.changed == keys_type{"list"});
+
+  BOOST_REQUIRE(co::diff(vm_new,vm_old).added == keys_type{"bar"});
+  BOOST_REQUIRE(co::diff(vm_old,vm_old).empty());
+  BOOST_REQUIRE(co::diff(co::variable_map(),co::variable_map()).empty());
+
+  diff = co::diff(co::variable_map(),vm_new);
+  BOOST_REQUIRE((diff.added == keys_type{"baz","foo","list","qux"}));
+}
+
+/**
+  Values of types that are not registered can be parsed but are always
+  changed
+ */
+BOOST_AUTO_TEST_CASE( unregistered_diff_test )
+{
+  co::options_group grp{
+    co::make_option("points",co::value<std::vector<point> >(),"points")
+  };
+
+  co::variable_map vm = parse(grp,{"--points","1"});
+  BOOST_REQUIRE(co::any_cast<std::vector<point> >(
+    vm.find("points")->second).front().x == 1);
+  BOOST_REQUIRE(co::diff(vm,vm).changed == keys_type{"points"});
+}
+
+/**
+  User types use compare_value once registered and are otherwise always
+  changed
+ */
+BOOST_AUTO_TEST_CASE( user_type_diff_test )
+{
+  co::variable_map vm_old{
+    {"empty",co::any()},
+    {"initial",co::any(initial{'a'})},
+    {"opaque",co::any(opaque{1})},
+    {"retyped",co::any(1)},
+    {"unregistered",co::any(initial{'a'})}
+  };
+  co::variable_map vm_new{
+    {"empty",co::any()},
+    {"initial",co::any(initial{'A'})},
+    {"opaque",co::any(opaque{1})},
+    {"retyped",co::any(1L)},
+    {"unregistered",co::any(initial{'a'})}
+  };
+
+  BOOST_REQUIRE((co::diff(vm_old,vm_new).changed ==
+    keys_type{"initial","opaque","retyped","unregistered"}));
+
+  co::register_value_equal<initial>();
+  co::register_value_equal<opaque>();
+  co::register_value_equal<int>();
+  co::register_value_equal<long>();
+
+  BOOST_REQUIRE((co::diff(vm_old,vm_new).changed ==
+    keys_type{"opaque","retyped"}));
+
+  vm_new.find("initial")->second = co::any(initial{'b'});
+  BOOST_REQUIRE((co::diff(vm_old,vm_new).changed ==
+    keys_type{"initial","opaque","retyped"}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
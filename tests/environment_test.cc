@@ -0,0 +1,139 @@
+#include "cmd_options.h"
+#include "cmd_options/environment.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+/**
+  environment source test
+ */
+
+BOOST_AUTO_TEST_SUITE( environment_test_suite )
+
+namespace co = cmd_options;
+
+co::options_group environment_group(std::size_t &count)
+{
+  co::options_group grp{
+    co::make_option("log-level",co::value<int>(),"case 3"),
+    co::make_option("verbose,v","case 2"),
+    co::make_option("quiet","case 2"),
+    co::make_option("name",co::value<std::string>(),"case 3",
+      co::constrain().occurrences(0,1))
+  };
+
+  for(auto &desc : grp) {
+    auto unpack_option = desc.unpack_option;
+    desc.unpack_option = [=,&count](const std::string &option) {
+      ++count;
+      return unpack_option(option);
+    };
+  }
+
+  return grp;
+}
+
+/**
+  Prefixed variables are mapped to options
+ */
+BOOST_AUTO_TEST_CASE( environment_parse_test )
+{
+  std::size_t count = 0;
+  const co::options_group grp = environment_group(count);
+
+  std::vector<const char *> env{
+    "PATH=/bin",
+    "APP_LOG_LEVEL=3",
+    "APP_VERBOSE=1",
+    "APP_QUIET=off",
+    "APP_UNKNOWN=1",
+    "APPNAME=ignored",
+    "APP_NAME=has=equals",
+    nullptr
+  };
+
+  co::environment_source source(grp,"APP_");
+
+  co::variable_map vm = source.parse(co::variable_map(),env.data());
+  BOOST_REQUIRE(detail::vm_check(vm,{
+    detail::check_value("log-level",3),
+    detail::check_value("name",std::string("has=equals")),
+    detail::check_empty(std::string("verbose"))
+  }));
+
+  // names are only looked up once
+  count = 0;
+  BOOST_REQUIRE(source.parse(co::variable_map(),env.data()).size() == 3);
+  BOOST_REQUIRE(count == 0);
+
+  // custom name mapping
+  std::vector<const char *> custom_env{"X_level=5",nullptr};
+  co::environment_source custom(grp,"X_",[](const std::string &name) {
+    return (name == "level" ? std::string("log-level") : std::string());
+  });
+  vm = custom.parse(co::variable_map(),custom_env.data());
+  BOOST_REQUIRE(detail::vm_check(vm,{
+    detail::check_value("log-level",5)
+  }));
+}
+
+/**
+  An empty value gives the implicit value of options that have one
+ */
+BOOST_AUTO_TEST_CASE( environment_implicit_test )
+{
+  const co::options_group grp{
+    co::make_option("color",co::value<std::string>().implicit("auto"),
+      "case 3"),
+    co::make_option("name",co::value<std::string>(),"case 3")
+  };
+
+  co::environment_source source(grp,"APP_");
+
+  std::vector<const char *> env{"APP_COLOR=","APP_NAME=",nullptr};
+  co::variable_map vm = source.parse(co::variable_map(),env.data());
+  BOOST_REQUIRE(detail::vm_check(vm,{
+    detail::check_value("color",std::string("auto")),
+    detail::check_value("name",std::string())
+  }));
+
+  env = {"APP_COLOR=never",nullptr};
+  vm = source.parse(co::variable_map(),env.data());
+  BOOST_REQUIRE(detail::vm_check(vm,{
+    detail::check_value("color",std::string("never"))
+  }));
+}
+
+/**
+  Errors name the variable and nest the original error
+ */
+BOOST_AUTO_TEST_CASE( environment_error_test )
+{
+  std::size_t count = 0;
+  const co::options_group grp = environment_group(count);
+
+  co::environment_source source(grp,"APP_");
+
+  std::vector<const char *> env{"APP_LOG_LEVEL=three",nullptr};
+  try {
+    source.parse(co::variable_map(),env.data());
+    BOOST_FAIL("expected environment_error");
+  }
+  catch(const co::environment_error &ex) {
+    BOOST_REQUIRE(std::string(ex.variable()) == "APP_LOG_LEVEL");
+    BOOST_REQUIRE_THROW(std::rethrow_if_nested(ex),
+      co::invalid_argument_error);
+  }
+
+  env = {"APP_VERBOSE=maybe",nullptr};
+  BOOST_REQUIRE_THROW(source.parse(co::variable_map(),env.data()),
+    co::environment_error);
+
+  // constraints include the given variable map
+  env = {"APP_NAME=foo",nullptr};
+  co::variable_map vm{{"name",co::any(std::string("bar"))}};
+  BOOST_REQUIRE_THROW(source.parse(vm,env.data()),co::occurrence_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
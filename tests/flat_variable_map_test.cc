@@ -0,0 +1,148 @@
+#include "cmd_options.h"
+#include "cmd_options/flat_variable_map.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+
+#include <sys/wait.h>
+
+/**
+  flat variable map test
+ */
+
+BOOST_AUTO_TEST_SUITE( flat_variable_map_test_suite )
+
+namespace co = cmd_options;
+
+co::variable_map make_vm(void)
+{
+  return co::variable_map{
+    {"flag",co::any()},
+    {"num",co::any(1)},
+    {"num",co::any(2)},
+    {"num",co::any(3)},
+    {"ratio",co::any(0.5)},
+    {"short",co::any(std::string("abc"))},
+    {"long",co::any(std::string("a string longer than its entry"))},
+    {"",co::any(std::string())}
+  };
+}
+
+/**
+  Keys are found in place and values are read by type
+ */
+BOOST_AUTO_TEST_CASE( flat_lookup_test )
+{
+  co::variable_map vm = make_vm();
+  co::flat_variable_map flat = co::flat_variable_map::make_shared(vm);
+
+  BOOST_REQUIRE(flat.size() == vm.size() && !flat.empty());
+  BOOST_REQUIRE(co::diff(vm,flat.to_variable_map()).empty());
+
+  for(std::size_t n=1; n<flat.size(); ++n)
+    BOOST_REQUIRE(flat.key(n-1) <= flat.key(n));
+
+  BOOST_REQUIRE(flat.count("num") == 3);
+  BOOST_REQUIRE(flat.count("nu") == 0 && flat.count("numb") == 0);
+  BOOST_REQUIRE(flat.find("missing") == co::flat_variable_map::npos);
+  BOOST_REQUIRE(flat.find("") == 0 && flat.key_size(0) == 0);
+
+  auto range = flat.equal_range("num");
+  for(std::size_t n=range.first; n<range.second; ++n)
+    BOOST_REQUIRE(flat.value<int>(n) == static_cast<int>(n-range.first+1));
+
+  BOOST_REQUIRE(flat.assert_last_value<int>("num") == 3);
+  BOOST_REQUIRE(flat.assert_last_value<double>("ratio") == 0.5);
+  BOOST_REQUIRE(flat.is_empty(flat.find("flag")));
+  BOOST_REQUIRE(flat.tag(flat.find("ratio")) == co::snapshot_double);
+
+  std::size_t n = flat.find("long");
+  BOOST_REQUIRE(std::string(flat.string_data(n),flat.string_size(n)) ==
+    "a string longer than its entry");
+  BOOST_REQUIRE(flat.value<std::string>(n) ==
+    "a string longer than its entry");
+  n = flat.find("short");
+  BOOST_REQUIRE(std::string(flat.string_data(n),flat.string_size(n)) ==
+    "abc");
+
+  BOOST_REQUIRE_THROW(flat.value<long>(flat.find("num")),co::bad_any_cast);
+  BOOST_REQUIRE_THROW(flat.string_data(flat.find("num")),co::bad_any_cast);
+
+  co::flat_variable_map none;
+  BOOST_REQUIRE(none.empty() && none.find("num") == none.npos);
+  BOOST_REQUIRE(none.to_variable_map().empty());
+
+  co::variable_map32 vm32{{U"key",co::any(std::u32string(U"value"))}};
+  co::flat_variable_map32 flat32 = co::flat_variable_map32::make_shared(vm32);
+  n = flat32.find(U"key");
+  BOOST_REQUIRE(flat32.value<std::u32string>(n) == U"value");
+  BOOST_REQUIRE(std::u32string(flat32.string_data(n),flat32.string_size(n)) ==
+    U"value");
+}
+
+/**
+  A snapshot file is mapped in place and invalid regions are rejected
+ */
+BOOST_AUTO_TEST_CASE( flat_file_test )
+{
+  co::variable_map vm = make_vm();
+  co::save_snapshot("flat_variable_map_test.snap",vm);
+
+  co::flat_variable_map flat =
+    co::flat_variable_map::map_file("flat_variable_map_test.snap");
+  std::remove("flat_variable_map_test.snap");
+
+  BOOST_REQUIRE(co::diff(vm,flat.to_variable_map()).empty());
+
+  // the mapping is kept by copies
+  co::flat_variable_map copy = flat;
+  flat = co::flat_variable_map();
+  BOOST_REQUIRE(copy.assert_last_value<int>("num") == 3);
+
+  BOOST_REQUIRE_THROW(
+    co::flat_variable_map::map_file("flat_variable_map_test_missing.snap"),
+    co::snapshot_error);
+
+  std::string snap = co::make_snapshot(vm);
+  std::vector<std::uint64_t> buf(snap.size()/8+1);
+  char *unaligned = reinterpret_cast<char *>(buf.data())+1;
+  std::memcpy(unaligned,snap.data(),snap.size());
+  BOOST_REQUIRE_THROW(co::flat_variable_map(unaligned,snap.size()),
+    co::snapshot_error);
+  BOOST_REQUIRE_THROW(co::wflat_variable_map(copy.data(),snap.size()),
+    co::snapshot_error);
+}
+
+/**
+  Forked processes read the shared region
+ */
+BOOST_AUTO_TEST_CASE( flat_fork_test )
+{
+  co::flat_variable_map flat = co::flat_variable_map::make_shared(make_vm());
+
+  std::vector<pid_t> children;
+  for(int i=0; i<4; ++i) {
+    pid_t pid = ::fork();
+    BOOST_REQUIRE(pid != -1);
+
+    if(pid == 0) {
+      bool good = flat.assert_last_value<int>("num") == 3 &&
+        flat.value<std::string>(flat.find("long")) ==
+          "a string longer than its entry";
+      ::_exit(good ? 0 : 1);
+    }
+
+    children.push_back(pid);
+  }
+
+  for(auto pid : children) {
+    int status = 0;
+    BOOST_REQUIRE(::waitpid(pid,&status,0) == pid);
+    BOOST_REQUIRE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
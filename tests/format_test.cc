@@ -42,6 +42,192 @@ BOOST_AUTO_TEST_CASE( all_flags_test )
   stream_select::cout << co::to_string(options);
 }
 
+/**
+  Streaming help output is the same as to_string
+ */
+BOOST_AUTO_TEST_CASE( write_help_test )
+{
+  options_group_type options = options_group_type{
+    co::make_option(_LIT("foo,f"),_LIT("Short description")),
+    co::make_option(_LIT("a-really-long-option-name,b"),
+      co::basic_value<string_type,detail::check_char_t>()
+        .implicit(_LIT("implicit")),
+      _LIT("A description that is long enough that it needs to be wrapped ")
+      _LIT("onto several lines in the second column")),
+    co::make_option(_LIT("hidden"),_LIT("Not shown"))
+  };
+  options.back().key_description = nullptr;
+
+  string_type expected =
+    _LIT("  --foo,-f                Short description\n")
+    _LIT("  --a-really-long-option-name,-b <arg=implicit>\n")
+    _LIT("                          A description that is long enough that it\n")
+    _LIT("                          needs to be wrapped onto several lines in the\n")
+    _LIT("                          second column\n");
+
+  BOOST_REQUIRE(co::to_string(options) == expected);
+
+  std::basic_ostringstream<detail::check_char_t> out;
+  BOOST_REQUIRE(co::write_help(out,options).good());
+  BOOST_REQUIRE(out.str() == expected);
+}
+
+/**
+  Wrapping counts code points rather than code units
+ */
+BOOST_AUTO_TEST_CASE( wrap_code_point_test )
+{
+  BOOST_REQUIRE(co::detail::wrap(string_type(_LIT("ÄÄÄ ÖÖÖ ÜÜÜ")),7) ==
+    _LIT("ÄÄÄ ÖÖÖ\nÜÜÜ"));
+
+  BOOST_REQUIRE(co::detail::wrap(string_type(_LIT("𝄞𝄞 𝄞𝄞 𝄞")),5) ==
+    _LIT("𝄞𝄞 𝄞𝄞\n𝄞"));
+}
+
+/**
+  The key column is padded by code points rather than code units
+ */
+BOOST_AUTO_TEST_CASE( key_column_code_point_test )
+{
+  // exactly fills the key column
+  options_group_type options = options_group_type{
+    co::make_option(_LIT("size,s"),
+      co::basic_value<string_type,detail::check_char_t>()
+        .description(_LIT("größenwert")),_LIT("S"))
+  };
+
+  BOOST_REQUIRE(co::to_string(options) ==
+    _LIT("  --size,-s <größenwert>  S\n"));
+}
+
+/*
+  Sort every entry equal
+*/
+class constant_key_formatter :
+  public co::basic_default_formatter<detail::check_char_t>
+{
+  public:
+    sort_key_type sort_key(void) const {
+      return [](const description_type &) { return string_type(); };
+    }
+};
+
+/**
+  Sorting uses each entry's key and is stable
+ */
+BOOST_AUTO_TEST_CASE( sorted_help_test )
+{
+  options_group_type options = options_group_type{
+    co::make_option(_LIT("cat,c"),_LIT("C")),
+    co::make_option(_LIT("apple,a"),_LIT("A")),
+    co::make_option(_LIT("bar,b"),_LIT("B"))
+  };
+
+  co::basic_default_formatter<detail::check_char_t> fmt;
+  fmt.sort_entries(true);
+
+  BOOST_REQUIRE(co::to_string(options,fmt) ==
+    _LIT("  --apple,-a              A\n")
+    _LIT("  --bar,-b                B\n")
+    _LIT("  --cat,-c                C\n"));
+
+  BOOST_REQUIRE(co::to_string(options,constant_key_formatter()) ==
+    _LIT("  --cat,-c                C\n")
+    _LIT("  --apple,-a              A\n")
+    _LIT("  --bar,-b                B\n"));
+}
+
+/*
+  Sort in reverse key order through compare
+*/
+class reverse_formatter :
+  public co::basic_default_formatter<detail::check_char_t>
+{
+  public:
+    compare_type compare(void) const {
+      return [](const description_type &lhs, const description_type &rhs) {
+        return rhs.key_description() < lhs.key_description();
+      };
+    }
+
+    sort_key_type sort_key(void) const {
+      return sort_key_type();
+    }
+};
+
+/**
+  An overridden compare is used when sorting
+ */
+BOOST_AUTO_TEST_CASE( compare_override_test )
+{
+  options_group_type options = options_group_type{
+    co::make_option(_LIT("cat,c"),_LIT("C")),
+    co::make_option(_LIT("apple,a"),_LIT("A")),
+    co::make_option(_LIT("bar,b"),_LIT("B"))
+  };
+
+  co::basic_default_formatter<detail::check_char_t> sorted;
+  sorted.sort_entries(true);
+  BOOST_REQUIRE(sorted.sort_key());
+
+  sorted.sort_entries(false);
+  BOOST_REQUIRE(!sorted.sort_key() && !sorted.compare());
+
+  reverse_formatter fmt;
+  fmt.sort_entries(true);
+
+  BOOST_REQUIRE(!fmt.sort_key());
+  BOOST_REQUIRE(co::to_string(options,fmt) ==
+    _LIT("  --cat,-c                C\n")
+    _LIT("  --bar,-b                B\n")
+    _LIT("  --apple,-a              A\n"));
+}
+
+/*
+  Brackets each entry through the documented customization point
+*/
+class bracket_formatter :
+  public co::basic_default_formatter<detail::check_char_t>
+{
+  public:
+    void write_description(string_type &out,
+      const description_type &desc) const
+    {
+      out.push_back('[');
+      co::basic_default_formatter<detail::check_char_t>::
+        write_description(out,desc);
+      out.push_back(']');
+    }
+};
+
+/**
+  Rendering uses an overridden write_description
+ */
+BOOST_AUTO_TEST_CASE( typeset_override_test )
+{
+  options_group_type options = options_group_type{
+    co::make_option(_LIT("foo,f"),_LIT("F")),
+    co::make_option(_LIT("bar,b"),_LIT("B"))
+  };
+
+  string_type expected =
+    _LIT("[  --foo,-f                F]\n")
+    _LIT("[  --bar,-b                B]\n");
+
+  bracket_formatter fmt;
+  BOOST_REQUIRE(co::to_string(options,fmt) == expected);
+
+  std::basic_ostringstream<detail::check_char_t> out;
+  co::write_help(out,options,fmt);
+  BOOST_REQUIRE(out.str() == expected);
+
+  string_type entry;
+  fmt.write_description(entry,options.front());
+  BOOST_REQUIRE(entry == _LIT("[  --foo,-f                F]"));
+
+  BOOST_REQUIRE(fmt.typeset_description(options.front()) == entry);
+}
+
 /*
 
 --bar,-b =<path>[/usr/local]
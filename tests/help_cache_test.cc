@@ -0,0 +1,159 @@
+#include "cmd_options.h"
+#include "cmd_options/help_cache.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+/**
+  help cache test
+ */
+
+BOOST_AUTO_TEST_SUITE( help_cache_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::basic_string<detail::check_char_t> string_type;
+typedef co::basic_options_group<detail::check_char_t> options_group_type;
+typedef co::basic_default_formatter<detail::check_char_t> formatter_type;
+typedef co::basic_help_cache<detail::check_char_t> help_cache_type;
+
+/*
+  Count the number of times each key description is typeset
+*/
+options_group_type counted_group(std::size_t &count)
+{
+  options_group_type options{
+    co::make_option(_LIT("foo,f"),_LIT("Foo description")),
+    co::make_option(_LIT("bar,b,mapped-bar"),
+      co::basic_value<string_type,detail::check_char_t>(),
+      _LIT("Bar description")),
+    co::make_option(_LIT("c"),_LIT("C description")),
+    co::make_option(_LIT("hidden"),_LIT("Not shown")),
+    co::make_operand(_LIT("operand"))
+  };
+  options[3].key_description = nullptr;
+
+  for(auto &desc : options) {
+    if(desc.key_description) {
+      auto key_description = desc.key_description;
+      desc.key_description = [=,&count](void) {
+        ++count;
+        return key_description();
+      };
+    }
+  }
+
+  return options;
+}
+
+/**
+  The full text matches to_string and is only typeset again when the group
+  or formatter settings change
+ */
+BOOST_AUTO_TEST_CASE( help_cache_full_test )
+{
+  std::size_t count = 0;
+  options_group_type options = counted_group(count);
+
+  const string_type expected = co::to_string(options);
+
+  help_cache_type cache;
+
+  count = 0;
+  BOOST_REQUIRE(cache.to_string(options) == expected);
+  BOOST_REQUIRE(count != 0);
+
+  count = 0;
+  BOOST_REQUIRE(cache.to_string(options) == expected);
+  BOOST_REQUIRE(cache.to_string(options,_LIT("foo")) ==
+    _LIT("  --foo,-f                Foo description\n"));
+  BOOST_REQUIRE(count == 0);
+
+  formatter_type fmt;
+  fmt.sort_entries(true);
+  const string_type sorted = co::to_string(options,fmt);
+
+  count = 0;
+  BOOST_REQUIRE(cache.to_string(options,fmt) == sorted);
+  BOOST_REQUIRE(count != 0);
+
+  count = 0;
+  BOOST_REQUIRE(cache.to_string(options,fmt) == sorted);
+  BOOST_REQUIRE(count == 0);
+
+  fmt.max_width(40);
+  const string_type narrow = co::to_string(options,fmt);
+  BOOST_REQUIRE(narrow != sorted);
+
+  count = 0;
+  BOOST_REQUIRE(cache.to_string(options,fmt) == narrow);
+  BOOST_REQUIRE(count != 0);
+
+  count = 0;
+  BOOST_REQUIRE(cache.to_string(options,fmt) == narrow);
+  BOOST_REQUIRE(count == 0);
+
+  cache.invalidate();
+  BOOST_REQUIRE(cache.to_string(options,fmt) == narrow);
+  BOOST_REQUIRE(count != 0);
+
+  options.push_back(co::make_option(_LIT("baz"),_LIT("Baz description")));
+  BOOST_REQUIRE(cache.to_string(options,fmt) == co::to_string(options,fmt));
+}
+
+/**
+  Entries are selected by option name and given in help order
+ */
+BOOST_AUTO_TEST_CASE( help_cache_subset_test )
+{
+  std::size_t count = 0;
+  const options_group_type options = counted_group(count);
+
+  help_cache_type cache;
+
+  BOOST_REQUIRE(cache.to_string(options,_LIT("bar")) ==
+    _LIT("  --bar,-b <arg>          Bar description\n"));
+  BOOST_REQUIRE(cache.to_string(options,_LIT("b")) ==
+    _LIT("  --bar,-b <arg>          Bar description\n"));
+
+  BOOST_REQUIRE(cache.to_string(options,_LIT("c")) ==
+    _LIT("  --c                     C description\n"));
+
+  BOOST_REQUIRE(cache.to_string(options,
+    std::vector<string_type>{_LIT("c"),_LIT("foo"),_LIT("c")}) ==
+    _LIT("  --foo,-f                Foo description\n")
+    _LIT("  --c                     C description\n"));
+
+  // a mapped key that is not also a name of the option selects nothing
+  BOOST_REQUIRE(cache.to_string(options,_LIT("mapped-bar")).empty());
+  BOOST_REQUIRE(cache.to_string(options,_LIT("hidden")).empty());
+  BOOST_REQUIRE(cache.to_string(options,_LIT("operand")).empty());
+}
+
+/**
+  Entries are found from the descriptions themselves and not from the
+  typeset key description
+ */
+BOOST_AUTO_TEST_CASE( help_cache_key_description_test )
+{
+  options_group_type options{
+    co::make_option(_LIT("foo,f"),_LIT("Foo description")),
+    co::make_option(_LIT("bar"),_LIT("Bar description"))
+  };
+  options[0].key_description = [](void) {
+    return string_type(_LIT("FOO or F"));
+  };
+  options[1].key_description = [](void) {
+    return string_type(_LIT("see --foo"));
+  };
+
+  help_cache_type cache;
+
+  BOOST_REQUIRE(cache.to_string(options,_LIT("foo")) ==
+    _LIT("  FOO or F                Foo description\n"));
+  BOOST_REQUIRE(cache.to_string(options,_LIT("bar")) ==
+    _LIT("  see --foo               Bar description\n"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
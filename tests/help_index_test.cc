@@ -0,0 +1,119 @@
+#include "cmd_options.h"
+#include "cmd_options/help_index.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+/**
+  help index test
+ */
+
+BOOST_AUTO_TEST_SUITE( help_index_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::basic_string<detail::check_char_t> string_type;
+typedef co::basic_options_group<detail::check_char_t> options_group_type;
+typedef co::basic_option_description<detail::check_char_t> description_type;
+typedef co::basic_help_index<detail::check_char_t> help_index_type;
+
+options_group_type indexed_group(void)
+{
+  options_group_type options{
+    co::make_option(_LIT("verbose,v"),_LIT("Print more OUTPUT")),
+    co::make_option(_LIT("output,o"),
+      co::basic_value<string_type,detail::check_char_t>(),
+      _LIT("Write to the given file")),
+    co::make_option(_LIT("quiet,q"),_LIT("Suppress all output")),
+    co::make_option(_LIT("format"),
+      co::basic_value<string_type,detail::check_char_t>(),
+      _LIT("Output format")),
+    co::make_option(_LIT("hidden-output"),_LIT("Not shown"))
+  };
+  options.back().key_description = nullptr;
+
+  // value descriptions rank between keys and extended descriptions
+  options[3].value_description = [](void) {
+    return string_type(_LIT("output-format"));
+  };
+
+  return options;
+}
+
+/**
+  Matches are ranked by field and then by group order
+ */
+BOOST_AUTO_TEST_CASE( help_index_rank_test )
+{
+  const options_group_type options = indexed_group();
+  help_index_type index(options);
+
+  std::vector<const description_type *> result = index.search(_LIT("output"));
+  BOOST_REQUIRE(result.size() == 4);
+  BOOST_REQUIRE(result[0] == &options[1]);
+  BOOST_REQUIRE(result[1] == &options[3]);
+  BOOST_REQUIRE(result[2] == &options[0]);
+  BOOST_REQUIRE(result[3] == &options[2]);
+
+  // prefixes and case
+  result = index.search(_LIT("VERB"));
+  BOOST_REQUIRE(result.size() == 1 && result[0] == &options[0]);
+
+  // every term must match
+  result = index.search(_LIT("output suppress"));
+  BOOST_REQUIRE(result.size() == 1 && result[0] == &options[2]);
+
+  BOOST_REQUIRE(index.search(_LIT("shown")).empty());
+  BOOST_REQUIRE(index.search(_LIT("missing")).empty());
+  BOOST_REQUIRE(index.search(_LIT("")).empty());
+  BOOST_REQUIRE(index.search(_LIT("--")).empty());
+}
+
+/**
+  The argument of a key is its value description and is not matched as
+  part of the key
+ */
+BOOST_AUTO_TEST_CASE( help_index_key_argument_test )
+{
+  // the value match comes first in group order
+  options_group_type options{
+    co::make_option(_LIT("format"),
+      co::basic_value<string_type,detail::check_char_t>(),
+      _LIT("Layout")),
+    co::make_option(_LIT("output,o"),
+      co::basic_value<string_type,detail::check_char_t>(),
+      _LIT("Destination"))
+  };
+  options[0].value_description = [](void) {
+    return string_type(_LIT("output-format"));
+  };
+
+  help_index_type index(options);
+
+  std::vector<const description_type *> result = index.search(_LIT("output"));
+  BOOST_REQUIRE(result.size() == 2);
+  BOOST_REQUIRE(result[0] == &options[1]);
+  BOOST_REQUIRE(result[1] == &options[0]);
+
+  // the key of each matches on its own
+  result = index.search(_LIT("format"));
+  BOOST_REQUIRE(result.size() == 1 && result[0] == &options[0]);
+}
+
+/**
+  Only the matching entries are typeset
+ */
+BOOST_AUTO_TEST_CASE( help_index_to_string_test )
+{
+  const options_group_type options = indexed_group();
+  help_index_type index(options);
+
+  BOOST_REQUIRE(index.to_string(_LIT("-q")) ==
+    _LIT("  --quiet,-q              Suppress all output\n"));
+
+  BOOST_REQUIRE(index.to_string(_LIT("file")) ==
+    _LIT("  --output,-o <arg>       Write to the given file\n"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
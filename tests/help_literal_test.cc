@@ -0,0 +1,88 @@
+#include "cmd_options.h"
+#include "cmd_options/help_literal.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+/**
+  help literal generation test
+ */
+
+BOOST_AUTO_TEST_SUITE( help_literal_test_suite )
+
+namespace co = cmd_options;
+
+/**
+  Each line of help is a separate literal and special characters are
+  escaped
+ */
+BOOST_AUTO_TEST_CASE( narrow_help_literal_test )
+{
+  co::options_group grp{
+    co::make_option("foo,f","Say \"hi\" to C:\\\\ and ?\?= Ä"),
+    co::make_option("bar,b","Bar")
+  };
+
+  std::ostringstream out;
+  co::write_help_literal(out,"help_text",grp);
+
+  BOOST_REQUIRE(out.str() ==
+    "const char help_text[] =\n"
+    "  \"  --foo,-f                Say \\\"hi\\\" to C:\\\\ and ?\\?= \\303\\204\\n\"\n"
+    "  \"  --bar,-b                Bar\\n\";\n");
+
+  std::ostringstream empty;
+  co::write_help_literal(empty,"help_text",co::options_group());
+  BOOST_REQUIRE(empty.str() == "const char help_text[] =\n  \"\";\n");
+}
+
+/**
+  Wide text uses the matching prefix and universal character names
+ */
+BOOST_AUTO_TEST_CASE( wide_help_literal_test )
+{
+  co::basic_options_group<char16_t> grp{
+    co::make_option(u"foo",u"\u00C4\U0001D11E")
+  };
+
+  std::ostringstream out;
+  co::write_help_literal(out,"help_text",grp);
+
+  BOOST_REQUIRE(out.str() ==
+    "const char16_t help_text[] =\n"
+    "  u\"  --foo                   \\U000000C4\\U0001D11E\\n\";\n");
+}
+
+/**
+  Text that is not valid UTF-16 or UTF-32 is written with the replacement
+  character
+ */
+BOOST_AUTO_TEST_CASE( invalid_help_literal_test )
+{
+  co::basic_options_group<char16_t> grp16{
+    co::make_option(u"foo",
+      std::u16string{char16_t(0xD800),u'a',char16_t(0xDC00)})
+  };
+
+  std::ostringstream out;
+  co::write_help_literal(out,"help_text",grp16);
+
+  BOOST_REQUIRE(out.str() ==
+    "const char16_t help_text[] =\n"
+    "  u\"  --foo                   \\U0000FFFDa\\U0000FFFD\\n\";\n");
+
+  co::basic_options_group<char32_t> grp32{
+    co::make_option(U"foo",
+      std::u32string{char32_t(0xDFFF),char32_t(0x110000)})
+  };
+
+  out.str(std::string());
+  co::write_help_literal(out,"help_text",grp32);
+
+  BOOST_REQUIRE(out.str() ==
+    "const char32_t help_text[] =\n"
+    "  U\"  --foo                   \\U0000FFFD\\U0000FFFD\\n\";\n");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,124 @@
+#include "cmd_options.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+/**
+  layered variable map test
+ */
+
+BOOST_AUTO_TEST_SUITE( layered_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::basic_string<detail::check_char_t> string_type;
+typedef co::basic_variable_map<detail::check_char_t> variable_map_type;
+typedef co::basic_layered_variable_map<detail::check_char_t>
+  layered_variable_map_type;
+
+variable_map_type make_vm(
+  std::initializer_list<std::pair<const string_type,int> > values)
+{
+  variable_map_type vm;
+  for(auto &val : values)
+    vm.emplace(val.first,co::any(val.second));
+  return vm;
+}
+
+/**
+  Overlaid keys resolve to the highest layer and match overlay()
+ */
+BOOST_AUTO_TEST_CASE( layered_overlay_test )
+{
+  variable_map_type defaults =
+    make_vm({{_LIT("foo"),1},{_LIT("bar"),2},{_LIT("bar"),3}});
+  variable_map_type config = make_vm({{_LIT("bar"),4},{_LIT("baz"),5}});
+  variable_map_type cmdline = make_vm({{_LIT("baz"),6},{_LIT("baz"),7}});
+
+  layered_variable_map_type layers;
+  layers.push_back(defaults).push_back(config).push_back(cmdline);
+
+  BOOST_REQUIRE(layers.layers() == 3);
+  BOOST_REQUIRE(layers.count(_LIT("foo")) == 1);
+  BOOST_REQUIRE(layers.count(_LIT("bar")) == 1);
+  BOOST_REQUIRE(layers.count(_LIT("baz")) == 2);
+  BOOST_REQUIRE(layers.count(_LIT("none")) == 0);
+
+  BOOST_REQUIRE(co::any_cast<int>(*layers.find(_LIT("foo"))) == 1);
+  BOOST_REQUIRE(co::any_cast<int>(*layers.find(_LIT("bar"))) == 4);
+  BOOST_REQUIRE(co::any_cast<int>(*layers.find(_LIT("baz"))) == 7);
+  BOOST_REQUIRE(layers.find(_LIT("none")) == nullptr);
+
+  std::vector<const co::any *> baz = layers.values(_LIT("baz"));
+  BOOST_REQUIRE(baz.size() == 2 && co::any_cast<int>(*baz[0]) == 6 &&
+    co::any_cast<int>(*baz[1]) == 7);
+
+  variable_map_type flat = layers.flatten();
+  BOOST_REQUIRE(detail::vm_check(flat,{
+    detail::check_value(_LIT("bar"),4),
+    detail::check_value(_LIT("baz"),6),
+    detail::check_value(_LIT("baz"),7),
+    detail::check_value(_LIT("foo"),1)
+  }));
+
+  BOOST_REQUIRE(flat.size() ==
+    co::overlay(co::overlay(defaults,config),cmdline).size());
+}
+
+/**
+  Appended keys collect every layer from the lowest and match append()
+ */
+BOOST_AUTO_TEST_CASE( layered_append_test )
+{
+  variable_map_type defaults =
+    make_vm({{_LIT("foo"),1},{_LIT("bar"),2},{_LIT("bar"),3}});
+  variable_map_type config = make_vm({{_LIT("bar"),4},{_LIT("foo"),5}});
+  variable_map_type cmdline = make_vm({{_LIT("bar"),6}});
+
+  layered_variable_map_type layers;
+  layers.push_back(defaults).push_back(config).push_back(cmdline);
+  layers.policy(_LIT("bar"),layered_variable_map_type::append);
+
+  BOOST_REQUIRE(layers.policy(_LIT("bar")) ==
+    layered_variable_map_type::append);
+  BOOST_REQUIRE(layers.policy(_LIT("foo")) ==
+    layered_variable_map_type::overlay);
+
+  BOOST_REQUIRE(layers.count(_LIT("bar")) == 4);
+  BOOST_REQUIRE(co::any_cast<int>(*layers.find(_LIT("bar"))) == 6);
+
+  std::vector<const co::any *> bar = layers.values(_LIT("bar"));
+  const int expected[] = {2,3,4,6};
+  BOOST_REQUIRE(bar.size() == 4);
+  for(std::size_t i=0; i<bar.size(); ++i)
+    BOOST_REQUIRE(co::any_cast<int>(*bar[i]) == expected[i]);
+
+  BOOST_REQUIRE(detail::vm_check(layers.flatten(),{
+    detail::check_value(_LIT("bar"),2),
+    detail::check_value(_LIT("bar"),3),
+    detail::check_value(_LIT("bar"),4),
+    detail::check_value(_LIT("bar"),6),
+    detail::check_value(_LIT("foo"),5)
+  }));
+}
+
+/**
+  Layers are held by reference and later changes are seen
+ */
+BOOST_AUTO_TEST_CASE( layered_reference_test )
+{
+  variable_map_type lower = make_vm({{_LIT("foo"),1}});
+  variable_map_type upper;
+
+  layered_variable_map_type layers;
+  layers.push_back(lower).push_back(upper);
+
+  BOOST_REQUIRE(co::any_cast<int>(*layers.find(_LIT("foo"))) == 1);
+
+  upper.emplace(_LIT("foo"),co::any(2));
+  BOOST_REQUIRE(co::any_cast<int>(*layers.find(_LIT("foo"))) == 2);
+  BOOST_REQUIRE(layered_variable_map_type().flatten().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
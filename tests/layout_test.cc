@@ -0,0 +1,147 @@
+#include "cmd_options.h"
+#include "cmd_options/layout.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+/**
+  column layout test
+ */
+
+BOOST_AUTO_TEST_SUITE( layout_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::basic_string<detail::check_char_t> string_type;
+typedef co::basic_options_group<detail::check_char_t> options_group_type;
+typedef co::basic_default_formatter<detail::check_char_t> formatter_type;
+typedef co::basic_column_layout<detail::check_char_t> layout_type;
+
+/*
+  Nine short keys and one long one
+*/
+options_group_type layout_group(std::size_t &count)
+{
+  options_group_type options;
+  for(detail::check_char_t c = 'a'; c < 'j'; ++c) {
+    options.push_back(co::make_option(string_type(4,c),
+      _LIT("A short option with a description that needs wrapping")));
+  }
+  options.push_back(co::make_option(
+    _LIT("a-very-long-option-name-that-does-not-fit"),
+    _LIT("The long one")));
+
+  for(auto &desc : options) {
+    auto key_description = desc.key_description;
+    desc.key_description = [=,&count](void) {
+      ++count;
+      return key_description();
+    };
+  }
+
+  return options;
+}
+
+/**
+  The key column is sized to the keys and the text to the given width
+ */
+BOOST_AUTO_TEST_CASE( column_layout_width_test )
+{
+  std::size_t count = 0;
+  const options_group_type options = layout_group(count);
+
+  layout_type layout;
+
+  // "  --aaaa" is 8 columns wide
+  formatter_type fmt = layout.formatter(options,60);
+  BOOST_REQUIRE(fmt.key_column_width() == 8);
+  BOOST_REQUIRE(fmt.max_width() == 60);
+  BOOST_REQUIRE(layout.to_string(options,60) == co::to_string(options,fmt));
+
+  const string_type first_entry =
+    _LIT("  --aaaa  A short option with a description that needs\n")
+    _LIT("          wrapping\n");
+  BOOST_REQUIRE(layout.to_string(options,60).compare(0,first_entry.size(),
+    first_entry) == 0);
+
+  // every key fits but limited to half the width
+  layout.key_fraction(1.0);
+  fmt = layout.formatter(options,60);
+  BOOST_REQUIRE(fmt.key_column_width() == 30);
+
+  fmt = layout.formatter(options,200);
+  BOOST_REQUIRE(fmt.key_column_width() == 45);
+
+  // room is left for the description
+  fmt = layout.formatter(options,40);
+  BOOST_REQUIRE(fmt.key_column_width() == 18);
+  BOOST_REQUIRE(fmt.max_width() == 40);
+
+  // but never wider than the given width
+  fmt = layout.formatter(options,10);
+  BOOST_REQUIRE(fmt.key_column_width() == 5);
+  BOOST_REQUIRE(fmt.max_width() == 10);
+
+  fmt = layout.formatter(options,3);
+  BOOST_REQUIRE(fmt.key_column_width() == 0);
+  BOOST_REQUIRE(fmt.max_width() == 3);
+
+  // unless it cannot even hold the padding
+  fmt = layout.formatter(options,2);
+  BOOST_REQUIRE(fmt.key_column_width() == 0);
+  BOOST_REQUIRE(fmt.max_width() == 3);
+
+  BOOST_REQUIRE(co::terminal_width() > 0);
+}
+
+/**
+  Keys are measured in code points as the formatter pads them
+ */
+BOOST_AUTO_TEST_CASE( column_layout_code_point_test )
+{
+  options_group_type options{
+    co::make_option(_LIT("size"),_LIT("Size")),
+  };
+  const string_type key = _LIT("--gr\u00f6\u00dfe");
+  options[0].key_description = [=](void) { return key; };
+
+  layout_type layout;
+  layout.key_fraction(1.0);
+
+  formatter_type fmt = layout.formatter(options,60);
+  // two for the indent and seven code points
+  BOOST_REQUIRE(fmt.key_column_width() == 9);
+  BOOST_REQUIRE(layout.to_string(options,60) ==
+    _LIT("  ")+key+_LIT("  Size\n"));
+}
+
+/**
+  The keys are only measured again when the group changes
+ */
+BOOST_AUTO_TEST_CASE( column_layout_measure_test )
+{
+  std::size_t count = 0;
+  options_group_type options = layout_group(count);
+
+  layout_type layout;
+
+  layout.formatter(options,80);
+  BOOST_REQUIRE(count == options.size());
+
+  count = 0;
+  layout.formatter(options,40);
+  layout.formatter(options,100);
+  BOOST_REQUIRE(count == 0);
+
+  layout.invalidate();
+  layout.formatter(options,80);
+  BOOST_REQUIRE(count == options.size());
+
+  count = 0;
+  options.push_back(co::make_option(_LIT("more"),_LIT("More")));
+  layout.formatter(options,80);
+  BOOST_REQUIRE(count == options.size()-1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
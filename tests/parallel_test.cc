@@ -0,0 +1,161 @@
+#include "cmd_options.h"
+#include "cmd_options/parallel.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+/**
+  parallel batch parsing test
+ */
+
+BOOST_AUTO_TEST_SUITE( parallel_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::basic_string<detail::check_char_t> string_type;
+typedef co::basic_options_group<detail::check_char_t> options_group_type;
+typedef co::basic_variable_map<detail::check_char_t> variable_map_type;
+typedef co::basic_batch_result<detail::check_char_t> batch_result_type;
+typedef std::vector<const detail::check_char_t *> argv_type;
+
+options_group_type batch_group(void)
+{
+  return options_group_type{
+    co::make_option(_LIT("foo,f"),co::value<int>(),_LIT("case 3")),
+    co::make_option(_LIT("bar,b"),_LIT("case 2"),
+      co::basic_constraint<detail::check_char_t>().occurrences(0,1)),
+    co::make_operand(_LIT("operand"),co::value<string_type>())
+  };
+}
+
+/**
+  Results are returned in input order regardless of the number of threads
+ */
+BOOST_AUTO_TEST_CASE( parse_batch_order_test )
+{
+  const options_group_type grp = batch_group();
+
+  std::vector<std::vector<string_type> > batch;
+  for(int i=0; i<200; ++i) {
+    std::basic_stringstream<detail::check_char_t> num;
+    num << i;
+
+    batch.push_back({_LIT("--foo"),num.str(),_LIT("-b"),num.str()});
+  }
+
+  for(std::size_t nthreads : {1,2,8}) {
+    co::thread_pool executor(nthreads);
+    BOOST_REQUIRE(executor.size() == nthreads);
+
+    std::vector<batch_result_type> results =
+      co::parse_batch(batch.begin(),batch.end(),grp,executor);
+
+    BOOST_REQUIRE(results.size() == batch.size());
+    for(std::size_t i=0; i<results.size(); ++i) {
+      BOOST_REQUIRE(!results[i].failed());
+      BOOST_REQUIRE(results[i].position == 4);
+      const variable_map_type &vm = results[i].vm;
+      BOOST_REQUIRE(vm.size() == 3 && vm.count(_LIT("bar")) == 1);
+      BOOST_REQUIRE(co::any_cast<int>(vm.find(_LIT("foo"))->second) ==
+        static_cast<int>(i));
+      BOOST_REQUIRE(co::any_cast<string_type>(
+        vm.find(_LIT("operand"))->second) == batch[i][1]);
+    }
+  }
+}
+
+/**
+  An error in one element is reported in its result and does not affect
+  the others
+ */
+BOOST_AUTO_TEST_CASE( parse_batch_error_test )
+{
+  const options_group_type grp = batch_group();
+
+  std::vector<argv_type> batch{
+    {_LIT("-f"),_LIT("1")},
+    {_LIT("--unknown")},
+    {_LIT("-b"),_LIT("-b")},
+    {_LIT("-f"),_LIT("one")},
+    {}
+  };
+
+  co::thread_pool executor(4);
+
+  std::vector<batch_result_type> results =
+    co::parse_batch(batch.begin(),batch.end(),grp,executor);
+
+  BOOST_REQUIRE(results.size() == 5);
+
+  BOOST_REQUIRE(!results[0].failed());
+  BOOST_REQUIRE(detail::vm_check(results[0].vm,{
+    detail::check_value(_LIT("foo"),1)
+  }));
+
+  BOOST_REQUIRE(results[1].failed());
+  BOOST_REQUIRE_THROW(std::rethrow_exception(results[1].error),
+    co::unknown_option_error);
+
+  BOOST_REQUIRE(results[2].failed());
+  BOOST_REQUIRE_THROW(std::rethrow_exception(results[2].error),
+    co::occurrence_error);
+
+  BOOST_REQUIRE(results[3].failed());
+  BOOST_REQUIRE_THROW(std::rethrow_exception(results[3].error),
+    co::invalid_argument_error);
+
+  BOOST_REQUIRE(!results[4].failed());
+  BOOST_REQUIRE(results[4].vm.empty());
+}
+
+/**
+  The pool rethrows the first exception after all indices are visited
+ */
+BOOST_AUTO_TEST_CASE( thread_pool_exception_test )
+{
+  co::thread_pool executor(4);
+
+  std::vector<int> visited(100,0);
+  BOOST_REQUIRE_THROW(
+    executor.for_each_index(visited.size(),[&](std::size_t i) {
+      visited[i] = 1;
+      if(i%10 == 0)
+        throw std::runtime_error("index");
+    }),
+    std::runtime_error);
+
+  BOOST_REQUIRE(std::count(visited.begin(),visited.end(),1) == 100);
+}
+
+/**
+  Parallel typesetting gives the same text as to_string
+ */
+BOOST_AUTO_TEST_CASE( parallel_to_string_test )
+{
+  options_group_type grp;
+  for(int i=0; i<500; ++i) {
+    std::basic_stringstream<detail::check_char_t> name;
+    name << _LIT("option-") << (i*7919)%500;
+
+    string_type desc(static_cast<std::size_t>(i%90),'x');
+    grp.push_back(co::make_option(name.str(),co::value<int>(),
+      _LIT("Description ") + desc + _LIT(" with %V")));
+  }
+  grp.push_back(co::make_option(_LIT("hidden"),_LIT("Not shown")));
+  grp.back().key_description = nullptr;
+
+  co::basic_default_formatter<detail::check_char_t> sorted;
+  sorted.sort_entries(true);
+
+  for(std::size_t nthreads : {1,2,8}) {
+    co::thread_pool executor(nthreads);
+
+    BOOST_REQUIRE(co::to_string(grp,executor) == co::to_string(grp));
+    BOOST_REQUIRE(co::to_string(grp,sorted,executor) ==
+      co::to_string(grp,sorted));
+    BOOST_REQUIRE(co::to_string(options_group_type(),executor).empty());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,410 @@
+#include "cmd_options.h"
+#include "cmd_options/environment.h"
+#include "cmd_options/parse_cache.h"
+#include "cmd_options/response_file.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include <utime.h>
+
+/**
+  parse cache test
+ */
+
+BOOST_AUTO_TEST_SUITE( parse_cache_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::vector<const char *> argv_type;
+
+/*
+  A cache directory that is removed at the end of the test
+*/
+struct scoped_directory {
+  scoped_directory(void) {
+    char name[] = "parse_cache_test.XXXXXX";
+    BOOST_REQUIRE(::mkdtemp(name));
+    path = name;
+  }
+
+  ~scoped_directory(void) {
+    for(auto &name : files())
+      std::remove((path + "/" + name).c_str());
+    ::rmdir(path.c_str());
+  }
+
+  std::vector<std::string> files(void) const {
+    std::vector<std::string> result;
+    DIR *dir = ::opendir(path.c_str());
+    while(struct dirent *ent = ::readdir(dir)) {
+      std::string name = ent->d_name;
+      if(name != "." && name != "..")
+        result.push_back(name);
+    }
+    ::closedir(dir);
+    return result;
+  }
+
+  std::string path;
+};
+
+std::string cache_file(const std::string &directory, std::uint64_t hash)
+{
+  char name[32];
+  std::snprintf(name,sizeof(name),"/%016llx.snap",
+    static_cast<unsigned long long>(hash));
+  return directory + name;
+}
+
+void set_mtime(const std::string &filename, std::time_t mtime)
+{
+  struct utimbuf times{mtime,mtime};
+  BOOST_REQUIRE(::utime(filename.c_str(),&times) == 0);
+}
+
+co::options_group make_group(void)
+{
+  return co::options_group{
+    co::make_option("num,n",co::value<int>(),"num"),
+    co::make_option("name",co::value<std::string>(),"name")
+  };
+}
+
+/*
+  Parse through the cache counting the misses
+*/
+struct counted_parse {
+  counted_parse(const co::parse_cache &_cache, const co::options_group &_grp)
+    :cache(_cache), grp(_grp), misses(0) {}
+
+  co::variable_map operator()(const argv_type &argv,
+    const std::vector<std::string> &sources = {})
+  {
+    return cache.parse(argv.begin(),argv.end(),grp,sources,[&](void) {
+      ++misses;
+      return co::parse_arguments(argv.data(),argv.data()+argv.size(),
+        grp).second;
+    });
+  }
+
+  const co::parse_cache &cache;
+  const co::options_group &grp;
+  std::size_t misses;
+};
+
+/**
+  Results are reused for the same arguments, group, and sources
+ */
+BOOST_AUTO_TEST_CASE( parse_cache_hit_test )
+{
+  scoped_directory dir;
+  co::parse_cache cache(dir.path);
+  co::options_group grp = make_group();
+  counted_parse parse(cache,grp);
+
+  argv_type argv{"-n","1","--name","first"};
+
+  co::variable_map vm = parse(argv);
+  BOOST_REQUIRE(parse.misses == 1);
+  BOOST_REQUIRE(co::diff(vm,parse(argv)).empty());
+  BOOST_REQUIRE(parse.misses == 1);
+  BOOST_REQUIRE(dir.files().size() == 1);
+
+  // the same arguments in a different order or changed
+  parse({"--name","first","-n","1"});
+  parse({"-n","1","--name","firs"});
+  BOOST_REQUIRE(parse.misses == 3);
+
+  // the structure of the group differs
+  co::options_group other = make_group();
+  other.push_back(co::make_option("flag","flag"));
+  counted_parse other_parse(cache,other);
+  other_parse(argv);
+  BOOST_REQUIRE(other_parse.misses == 1);
+
+  // a different salt
+  co::parse_cache salted(dir.path,1024*1024,"2.0");
+  counted_parse salted_parse(salted,grp);
+  salted_parse(argv);
+  BOOST_REQUIRE(salted_parse.misses == 1);
+
+  // the directory is missing so nothing is cached
+  co::parse_cache missing(dir.path + "/missing");
+  counted_parse missing_parse(missing,grp);
+  missing_parse(argv);
+  missing_parse(argv);
+  BOOST_REQUIRE(missing_parse.misses == 2);
+}
+
+/**
+  Bound variables are only assigned when the arguments are parsed
+ */
+BOOST_AUTO_TEST_CASE( parse_cache_binding_test )
+{
+  scoped_directory dir;
+  co::parse_cache cache(dir.path);
+
+  int bound = 0;
+  co::options_group grp{
+    co::make_option("num,n",co::value<int>(&bound),"num")
+  };
+  counted_parse parse(cache,grp);
+
+  argv_type argv{"-n","1"};
+
+  parse(argv);
+  BOOST_REQUIRE(parse.misses == 1 && bound == 1);
+
+  bound = 0;
+  co::variable_map vm = parse(argv);
+  BOOST_REQUIRE(parse.misses == 1 && bound == 0);
+  BOOST_REQUIRE(detail::vm_check(vm,{
+    detail::check_value("num",1)
+  }));
+}
+
+/**
+  A change to a source file is a miss
+ */
+BOOST_AUTO_TEST_CASE( parse_cache_source_test )
+{
+  scoped_directory dir;
+  co::parse_cache cache(dir.path);
+  co::options_group grp = make_group();
+  counted_parse parse(cache,grp);
+
+  std::string source = dir.path + "/source.cfg.txt";
+  std::vector<std::string> sources{source};
+  argv_type argv{"-n","1"};
+
+  parse(argv,sources);
+  parse(argv,sources);
+  BOOST_REQUIRE(parse.misses == 1);
+
+  std::ofstream(source.c_str()) << "num = 2\n";
+  parse(argv,sources);
+  parse(argv,sources);
+  BOOST_REQUIRE(parse.misses == 2);
+
+  std::ofstream(source.c_str()) << "num = 23\n";
+  parse(argv,sources);
+  BOOST_REQUIRE(parse.misses == 3);
+}
+
+/**
+  The least recently used results are removed and unreadable results are
+  misses
+ */
+BOOST_AUTO_TEST_CASE( parse_cache_evict_test )
+{
+  scoped_directory dir;
+  co::options_group grp = make_group();
+
+  argv_type first{"-n","1"};
+  argv_type second{"-n","2"};
+  co::parse_cache::key_type key =
+    co::parse_cache(dir.path).fingerprint(first.begin(),first.end(),grp);
+  std::string first_file = cache_file(dir.path,key.hash);
+  std::string second_file = cache_file(dir.path,
+    co::parse_cache(dir.path).fingerprint(second.begin(),second.end(),
+      grp).hash);
+
+  // every result here is the same size
+  std::size_t size;
+  {
+    co::parse_cache unbounded(dir.path);
+    counted_parse(unbounded,grp)(first);
+    struct stat st;
+    BOOST_REQUIRE(::stat(first_file.c_str(),&st) == 0);
+    size = static_cast<std::size_t>(st.st_size);
+    std::remove(first_file.c_str());
+  }
+
+  co::parse_cache cache(dir.path,size*2);
+  counted_parse parse(cache,grp);
+
+  parse(first);
+  parse(second);
+  BOOST_REQUIRE(parse.misses == 2);
+  BOOST_REQUIRE(dir.files().size() == 2);
+
+  // the second result was used more recently than the first
+  std::time_t now = std::time(nullptr);
+  set_mtime(first_file,now-20);
+  set_mtime(second_file,now-10);
+
+  parse({"-n","3"});
+  BOOST_REQUIRE(dir.files().size() == 2);
+
+  parse(second);
+  BOOST_REQUIRE(parse.misses == 3);
+  parse(first);
+  BOOST_REQUIRE(parse.misses == 4);
+
+  std::ofstream(first_file.c_str()) << "corrupt";
+
+  co::variable_map vm;
+  BOOST_REQUIRE(!cache.find(key,vm));
+  BOOST_REQUIRE(detail::vm_check(parse(first),{
+    detail::check_value("num",1)
+  }));
+  BOOST_REQUIRE(parse.misses == 5);
+  BOOST_REQUIRE(cache.find(key,vm));
+}
+
+/**
+  Temporary files left by writers that did not finish are removed once
+  they are stale
+ */
+BOOST_AUTO_TEST_CASE( parse_cache_stale_tmp_test )
+{
+  scoped_directory dir;
+  co::parse_cache cache(dir.path);
+
+  std::string stale = dir.path + "/0000000000000001.snap.1.0.tmp";
+  std::string fresh = dir.path + "/0000000000000002.snap.1.0.tmp";
+  std::string other = dir.path + "/other.tmp";
+  std::ofstream(stale.c_str()) << "stale";
+  std::ofstream(fresh.c_str()) << "fresh";
+  std::ofstream(other.c_str()) << "other";
+
+  std::time_t old = std::time(nullptr)-co::parse_cache::stale_seconds-10;
+  set_mtime(stale,old);
+  set_mtime(other,old);
+
+  cache.evict();
+
+  std::vector<std::string> files = dir.files();
+  std::sort(files.begin(),files.end());
+  BOOST_REQUIRE(files == std::vector<std::string>({
+    "0000000000000002.snap.1.0.tmp","other.tmp"
+  }));
+}
+
+/**
+  A result is found only for the same key material even if the hash is
+  the same
+ */
+BOOST_AUTO_TEST_CASE( parse_cache_material_test )
+{
+  scoped_directory dir;
+  co::parse_cache cache(dir.path);
+  co::options_group grp = make_group();
+
+  argv_type argv{"-n","1"};
+  co::parse_cache::key_type key =
+    cache.fingerprint(argv.begin(),argv.end(),grp);
+
+  co::parse_cache::key_type collision = key;
+  collision.material.back() ^= 1;
+  cache.store(collision,
+    co::parse_arguments(argv.data(),argv.data()+argv.size(),grp).second);
+
+  co::variable_map vm;
+  BOOST_REQUIRE(!cache.find(key,vm));
+  BOOST_REQUIRE(cache.find(collision,vm));
+  BOOST_REQUIRE(detail::vm_check(vm,{
+    detail::check_value("num",1)
+  }));
+}
+
+/**
+  A change to a response file read by the parse is a miss
+ */
+BOOST_AUTO_TEST_CASE( parse_cache_response_file_test )
+{
+  scoped_directory dir;
+  co::parse_cache cache(dir.path);
+  co::options_group grp = make_group();
+
+  std::string filename = dir.path + "/args.rsp";
+  std::string arg = "@" + filename;
+  argv_type argv{arg.c_str()};
+
+  std::size_t misses = 0;
+  auto parse = [&](void) {
+    return cache.parse(argv.begin(),argv.end(),grp,{},[&](void) {
+      ++misses;
+      co::response_files files(argv.begin(),argv.end());
+      return co::parse_arguments(files.begin(),files.end(),grp).second;
+    });
+  };
+
+  std::ofstream(filename.c_str()) << "-n 1";
+  parse();
+  BOOST_REQUIRE(detail::vm_check(parse(),{
+    detail::check_value("num",1)
+  }));
+  BOOST_REQUIRE(misses == 1);
+
+  std::ofstream(filename.c_str()) << "-n 23";
+  BOOST_REQUIRE(detail::vm_check(parse(),{
+    detail::check_value("num",23)
+  }));
+  BOOST_REQUIRE(misses == 2);
+
+  // the same size but older
+  std::ofstream(filename.c_str()) << "-n 45";
+  set_mtime(filename,std::time(nullptr)-10);
+  BOOST_REQUIRE(detail::vm_check(parse(),{
+    detail::check_value("num",45)
+  }));
+  BOOST_REQUIRE(misses == 3);
+}
+
+/**
+  A change to the environment variables read by the parse is a miss
+ */
+BOOST_AUTO_TEST_CASE( parse_cache_environment_test )
+{
+  scoped_directory dir;
+  co::parse_cache cache(dir.path);
+  co::options_group grp = make_group();
+
+  ::unsetenv("PARSE_CACHE_TEST_NAME");
+  ::setenv("PARSE_CACHE_TEST_NUM","1",1);
+
+  argv_type argv;
+  std::size_t misses = 0;
+  auto parse = [&](void) {
+    return cache.parse(argv.begin(),argv.end(),grp,{},[&](void) {
+      ++misses;
+      return co::environment_source(grp,"PARSE_CACHE_TEST_").parse();
+    });
+  };
+
+  parse();
+  parse();
+  BOOST_REQUIRE(misses == 1);
+
+  ::setenv("PARSE_CACHE_TEST_NUM","2",1);
+  BOOST_REQUIRE(detail::vm_check(parse(),{
+    detail::check_value("num",2)
+  }));
+  BOOST_REQUIRE(misses == 2);
+
+  // a variable that was not set before
+  ::setenv("PARSE_CACHE_TEST_NAME","name",1);
+  BOOST_REQUIRE(detail::vm_check(parse(),{
+    detail::check_value("name",std::string("name")),
+    detail::check_value("num",2)
+  }));
+  BOOST_REQUIRE(misses == 3);
+
+  // variables without the prefix are not read
+  ::setenv("PARSE_CACHE_OTHER","other",1);
+  parse();
+  BOOST_REQUIRE(misses == 3);
+
+  ::unsetenv("PARSE_CACHE_TEST_NAME");
+  ::unsetenv("PARSE_CACHE_TEST_NUM");
+  ::unsetenv("PARSE_CACHE_OTHER");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
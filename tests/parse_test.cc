@@ -63,7 +63,7 @@ option_description_type nested1{
   [](void) -> string_type {
     return _LIT("test nested");
   },
-  {},{},{},{},{},{}
+  {},{},{},{},{},{},{}
 };
 
 option_description_type nested2{
@@ -81,7 +81,7 @@ option_description_type nested2{
   [](void) -> string_type {
     return _LIT("test nested2");
   },
-  {},{},{},{},{},{}
+  {},{},{},{},{},{},{}
 };
 
 option_description_type nested3{
@@ -99,7 +99,25 @@ option_description_type nested3{
   [](void) -> string_type {
     return _LIT("test nested3");
   },
-  {},{},{},{},{},{}
+  {},{},{},{},{},{},{}
+};
+
+option_description_type nested4{
+  [](const string_type &option) -> option_pack_type {
+    if(option == _LIT("-foo"))
+      return option_pack_type(true,false,_LIT("foo"),
+        {_LIT("-c"),_LIT("pos")},{},_LIT("ab"));
+    return option_pack_type(false);
+  },
+  [](const string_type &raw_key, std::size_t, std::size_t,
+    const variable_map_type &)
+    {
+      return std::make_pair(co::parse_flag::accept,raw_key);
+    },
+  [](void) -> string_type {
+    return _LIT("test nested4");
+  },
+  {},{},{},{},{},{},{}
 };
 
 option_description_type make_operand_at(std::size_t posn, std::size_t argn)
@@ -120,7 +138,7 @@ option_description_type make_operand_at(std::size_t posn, std::size_t argn)
     {
       return co::any(value);
     },
-    {},{},{},{}
+    {},{},{},{},{}
   };
 }
 
@@ -137,7 +155,7 @@ option_description_type throw_operand{
       << _argn << "\n";
     throw std::runtime_error(err.str());
   },
-  {},{},{},{},{},{},{}
+  {},{},{},{},{},{},{},{}
 };
 
 /*
@@ -154,7 +172,7 @@ option_description_type accept_and_terminate_option{
           co::parse_flag::terminate),raw_key);
     return std::make_pair(co::parse_flag::reject,string_type());
   },
-  {},{},{},{},{},{},{}
+  {},{},{},{},{},{},{},{}
 };
 
 option_description_type make_accept_and_terminate_operand_at(std::size_t posn,
@@ -179,7 +197,7 @@ option_description_type make_accept_and_terminate_operand_at(std::size_t posn,
     {
       return co::any(value);
     },
-    {},{},{},{}
+    {},{},{},{},{}
   };
 }
 
@@ -539,6 +557,51 @@ BOOST_AUTO_TEST_CASE( parse_nested_operand_test )
     }));
 }
 
+/**
+  Packed flags are parsed in place and before any packed arguments
+ */
+BOOST_AUTO_TEST_CASE( parse_packed_flags_test )
+{
+  variable_map_type vm;
+  options_group_type options;
+  std::vector<const detail::check_char_t *> argv;
+
+  argv = std::vector<const detail::check_char_t *>{
+    _LIT("-foo"),
+    _LIT("-xyz")
+  };
+
+  options = options_group_type{
+    check_pos_arg(nested4,0,0),
+    check_pos_arg(co::make_option(_LIT(",a"),_LIT("case 2")),1,1),
+    check_pos_arg(co::make_option(_LIT(",b"),_LIT("case 2")),2,2),
+    check_pos_arg(co::make_option(_LIT(",c"),_LIT("case 2")),3,3),
+    check_pos_arg(make_operand_at(0,4),0,4),
+    check_pos_arg(co::make_option(_LIT(",x"),_LIT("case 2")),4,5),
+    check_pos_arg(co::make_option(_LIT(",y"),_LIT("case 2")),5,6),
+    check_pos_arg(co::make_option(_LIT(",z"),_LIT("case 2")),6,7),
+    throw_operand
+  };
+
+  const detail::check_char_t ** res;
+  std::tie(res,vm) =
+    co::parse_arguments(argv.data(),argv.data()+argv.size(),options);
+
+  BOOST_REQUIRE(res == argv.data()+argv.size());
+
+  BOOST_REQUIRE(detail::contents_equal<string_type>(vm,
+    variable_map_type{
+      {_LIT("operand_key"),{string_type(_LIT("pos"))}},
+      {_LIT("a"),{}},
+      {_LIT("b"),{}},
+      {_LIT("c"),{}},
+      {_LIT("foo"),{}},
+      {_LIT("x"),{}},
+      {_LIT("y"),{}},
+      {_LIT("z"),{}}
+    }));
+}
+
 /**
   Premature termination test
  */
@@ -730,5 +793,81 @@ BOOST_AUTO_TEST_CASE( premature_terminate_test6 )
 }
 
 
+/**
+  Everything after end of options is an operand
+ */
+BOOST_AUTO_TEST_CASE( end_of_options_operand_test )
+{
+  options_group_type options;
+  std::vector<const detail::check_char_t *> argv;
+
+  argv = std::vector<const detail::check_char_t *>{
+    _LIT("--foo0"),
+    _LIT("operand0"),
+    _LIT("--"),
+    _LIT("--foo0"),
+    _LIT("operand1"),
+    _LIT("--"),
+    _LIT("-f"),
+  };
+
+  options = options_group_type{
+    check_pos_arg(co::make_option(_LIT("foo0"),_LIT("case 2")),0,0),
+    check_pos_arg(make_operand_at(0,1),0,1),
+    co::make_operand(_LIT("key"),
+      co::basic_value<string_type,detail::check_char_t>()),
+  };
+
+  variable_map_type vm;
+  const detail::check_char_t ** res;
+  std::tie(res,vm) =
+    co::parse_arguments(argv.data(),argv.data()+argv.size(),options);
+
+  BOOST_REQUIRE(res == argv.data()+argv.size());
+
+  BOOST_REQUIRE(detail::contents_equal<string_type>(vm,
+    variable_map_type{
+      {_LIT("foo0"),{}},
+      {_LIT("key"),{string_type(_LIT("--foo0"))}},
+      {_LIT("key"),{string_type(_LIT("operand1"))}},
+      {_LIT("key"),{string_type(_LIT("--"))}},
+      {_LIT("key"),{string_type(_LIT("-f"))}},
+      {_LIT("operand_key"),{string_type(_LIT("operand0"))}},
+    }));
+}
+
+BOOST_AUTO_TEST_CASE( end_of_options_terminate_test )
+{
+  options_group_type options;
+  std::vector<const detail::check_char_t *> argv;
+
+  argv = std::vector<const detail::check_char_t *>{
+    _LIT("--"),
+    _LIT("operand1"),
+    _LIT("operand2"),
+    _LIT("operand3"),
+  };
+
+  options = options_group_type{
+    make_accept_and_terminate_operand_at(1,1),
+    make_operand_at(0,0),
+    make_operand_at(2,2),
+  };
+
+  variable_map_type vm;
+  const detail::check_char_t ** res;
+  std::tie(res,vm) =
+    co::parse_arguments(argv.data(),argv.data()+argv.size(),options);
+
+  BOOST_REQUIRE(res == argv.data()+2);
+
+  BOOST_REQUIRE(detail::contents_equal<string_type>(vm,
+    variable_map_type{
+      {_LIT("operand_key"),{string_type(_LIT("operand1"))}},
+      {_LIT("terminate"),{string_type(_LIT("operand2"))}}
+    }));
+}
+
+
 BOOST_AUTO_TEST_SUITE_END()
 
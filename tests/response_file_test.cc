@@ -0,0 +1,115 @@
+#include "cmd_options.h"
+#include "cmd_options/response_file.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <fstream>
+
+/**
+  response file test
+ */
+
+BOOST_AUTO_TEST_SUITE( response_file_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::vector<std::string> args_type;
+
+/*
+  Write a response file that is removed at the end of the test
+*/
+struct scoped_file {
+  scoped_file(const std::string &_name, const std::string &contents)
+    :name(_name)
+  {
+    std::ofstream out(name.c_str(),std::ios::binary);
+    out << contents;
+  }
+
+  ~scoped_file(void) {
+    std::remove(name.c_str());
+  }
+
+  std::string name;
+};
+
+args_type expand(const args_type &args)
+{
+  co::response_files files(args.begin(),args.end());
+  return args_type(files.begin(),files.end());
+}
+
+/**
+  Quoting and nested response files
+ */
+BOOST_AUTO_TEST_CASE( response_file_quote_test )
+{
+  scoped_file inner("response_file_test_inner.rsp",
+    "--bar=\"two words\"\n@response_file_test_empty.rsp");
+  scoped_file outer("response_file_test_outer.rsp",
+    "  -f 'single \"quoted\"'\t\"esc\\\"aped\\\\\" back\\ slash\n"
+    "'' '@not-a-file' @response_file_test_inner.rsp last");
+  scoped_file empty("response_file_test_empty.rsp","");
+
+  BOOST_REQUIRE(expand({"first","@response_file_test_outer.rsp","@","end"}) ==
+    (args_type{"first","-f","single \"quoted\"","esc\"aped\\","back slash",
+      "","@not-a-file","--bar=two words","last","@","end"}));
+
+  // the last argument of a file without trailing whitespace
+  BOOST_REQUIRE(expand({"@response_file_test_inner.rsp"}) ==
+    (args_type{"--bar=two words"}));
+}
+
+/**
+  Expanded arguments are parsed as if they were given directly
+ */
+BOOST_AUTO_TEST_CASE( response_file_parse_test )
+{
+  scoped_file args("response_file_test_args.rsp","-f 1 --bar \"an operand\"");
+
+  co::options_group grp{
+    co::make_option("foo,f",co::value<int>(),"case 3"),
+    co::make_option("bar,b","case 2"),
+    co::make_operand("operand",co::value<std::string>())
+  };
+
+  std::vector<const char *> argv{"@response_file_test_args.rsp"};
+  co::response_files files(argv.begin(),argv.end());
+
+  co::variable_map vm;
+  std::tie(std::ignore,vm) =
+    co::parse_arguments(files.begin(),files.end(),grp);
+
+  BOOST_REQUIRE(detail::vm_check(vm,{
+    detail::check_empty(std::string("bar")),
+    detail::check_value("foo",1),
+    detail::check_value("operand",std::string("an operand"))
+  }));
+}
+
+/**
+  Missing files and cycles are errors
+ */
+BOOST_AUTO_TEST_CASE( response_file_error_test )
+{
+  scoped_file a("response_file_test_a.rsp","a @response_file_test_b.rsp");
+  scoped_file b("response_file_test_b.rsp","b @./response_file_test_a.rsp");
+
+  BOOST_REQUIRE_THROW(expand({"@response_file_test_a.rsp"}),
+    co::response_file_cycle_error);
+
+  try {
+    expand({"@response_file_test_missing.rsp"});
+    BOOST_FAIL("expected response_file_error");
+  }
+  catch(const co::response_file_error &ex) {
+    BOOST_REQUIRE(std::string(ex.filename()) ==
+      "response_file_test_missing.rsp");
+    BOOST_REQUIRE(ex.error() == ENOENT);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
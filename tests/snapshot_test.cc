@@ -0,0 +1,186 @@
+#include "cmd_options.h"
+#include "cmd_options/snapshot.h"
+
+#include "test_detail.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+
+/**
+  variable map snapshot test
+ */
+
+/*
+  A user type stored through a registered serializer
+*/
+struct endpoint {
+  std::string host;
+  int port;
+
+  bool operator==(const endpoint &rhs) const {
+    return host == rhs.host && port == rhs.port;
+  }
+};
+
+/*
+  A user type without a serializer
+*/
+struct unregistered {
+  int val;
+};
+
+BOOST_AUTO_TEST_SUITE( snapshot_test_suite )
+
+namespace co = cmd_options;
+
+typedef std::vector<const char *> argv_type;
+
+/**
+  Parsed values survive a round trip through a snapshot file
+ */
+BOOST_AUTO_TEST_CASE( snapshot_round_trip_test )
+{
+  co::options_group grp{
+    co::make_option("num,n",co::value<int>(),"num"),
+    co::make_option("name",co::value<std::string>(),"name"),
+    co::make_option("ratio",co::value<double>(),"ratio"),
+    co::make_option("verbose,v","verbose"),
+    co::make_option("big",co::value<unsigned long long>(),"big"),
+    co::make_option("flag",co::value<bool>(),"flag"),
+    co::make_option("wide",co::value<long double>(),"wide")
+  };
+
+  argv_type argv{"-n","1","--name","a longer string value","-v",
+    "--ratio","0.25","--num=-2","--name","","--big","18446744073709551615",
+    "--flag","true","--wide","1.5","-v"};
+
+  co::variable_map vm =
+    co::parse_arguments(argv.data(),argv.data()+argv.size(),grp).second;
+
+  co::save_snapshot("snapshot_test_round_trip.snap",vm);
+  co::variable_map loaded =
+    co::load_snapshot("snapshot_test_round_trip.snap");
+  std::remove("snapshot_test_round_trip.snap");
+
+  BOOST_REQUIRE(loaded.size() == vm.size());
+  BOOST_REQUIRE(co::diff(vm,loaded).empty());
+
+  auto name = loaded.equal_range("name");
+  BOOST_REQUIRE(co::any_cast<std::string>(name.first->second) ==
+    "a longer string value");
+  BOOST_REQUIRE(co::any_cast<std::string>((++name.first)->second).empty());
+  BOOST_REQUIRE(co::any_cast<unsigned long long>(
+    loaded.find("big")->second) == 18446744073709551615ULL);
+  BOOST_REQUIRE(co::is_empty(loaded.find("verbose")->second));
+
+  BOOST_REQUIRE(co::read_snapshot(co::make_snapshot(co::variable_map()).data(),
+    co::make_snapshot(co::variable_map()).size()).empty());
+}
+
+/**
+  Saving over a snapshot replaces the file so that a mapping of the
+  previous file is not changed
+ */
+BOOST_AUTO_TEST_CASE( snapshot_replace_test )
+{
+  co::variable_map first{{"key",co::any(std::string("first value"))}};
+  co::variable_map second{{"key",co::any(std::string("second value"))}};
+
+  co::save_snapshot("snapshot_test_replace.snap",first);
+  co::detail::mapped_snapshot file =
+    co::detail::map_snapshot("snapshot_test_replace.snap");
+
+  co::save_snapshot("snapshot_test_replace.snap",second);
+  co::variable_map loaded =
+    co::load_snapshot("snapshot_test_replace.snap");
+  std::remove("snapshot_test_replace.snap");
+
+  BOOST_REQUIRE(co::diff(second,loaded).empty());
+  BOOST_REQUIRE(co::diff(first,co::read_snapshot(file.data,file.size)).empty());
+}
+
+/**
+  User types are stored through their registered serializer
+ */
+BOOST_AUTO_TEST_CASE( snapshot_user_type_test )
+{
+  co::register_snapshot_type<endpoint>(co::snapshot_user+1,
+    [](const endpoint &val, std::string &out) {
+      out.append(reinterpret_cast<const char *>(&val.port),sizeof(val.port));
+      out.append(val.host);
+    },
+    [](const char *data, std::size_t size) {
+      endpoint val;
+      std::memcpy(&val.port,data,sizeof(val.port));
+      val.host.assign(data+sizeof(val.port),size-sizeof(val.port));
+      return val;
+    });
+  co::register_value_equal<endpoint>();
+
+  co::variable_map vm{
+    {"local",co::any(endpoint{"localhost",80})},
+    {"remote",co::any(endpoint{"example.com",8080})}
+  };
+
+  std::string snap = co::make_snapshot(vm);
+  co::variable_map loaded = co::read_snapshot(snap.data(),snap.size());
+  BOOST_REQUIRE(loaded.size() == 2 && co::diff(vm,loaded).empty());
+
+  vm.emplace("other",co::any(unregistered{1}));
+  BOOST_REQUIRE_THROW(co::make_snapshot(vm),co::snapshot_error);
+
+  BOOST_REQUIRE_THROW(co::register_snapshot_type<unregistered>(
+    co::snapshot_int,
+    [](const unregistered &, std::string &) {},
+    [](const char *, std::size_t) { return unregistered{0}; }),
+    std::invalid_argument);
+
+  // a tag belongs to a single type
+  BOOST_REQUIRE_THROW(co::register_snapshot_type<unregistered>(
+    co::snapshot_user+1,
+    [](const unregistered &, std::string &) {},
+    [](const char *, std::size_t) { return unregistered{0}; }),
+    std::invalid_argument);
+  BOOST_REQUIRE_THROW(co::register_snapshot_type<int>(co::snapshot_user+2,
+    [](const int &, std::string &) {},
+    [](const char *, std::size_t) { return 0; }),
+    std::invalid_argument);
+
+  vm.erase("other");
+  snap = co::make_snapshot(vm);
+  loaded = co::read_snapshot(snap.data(),snap.size());
+  BOOST_REQUIRE(loaded.size() == 2 && co::diff(vm,loaded).empty());
+}
+
+/**
+  Invalid snapshots are rejected
+ */
+BOOST_AUTO_TEST_CASE( snapshot_invalid_test )
+{
+  co::variable_map vm{{"key",co::any(std::string("value"))}};
+  std::string snap = co::make_snapshot(vm);
+
+  BOOST_REQUIRE_THROW(co::read_snapshot(snap.data(),snap.size()-8),
+    co::snapshot_error);
+  BOOST_REQUIRE_THROW(co::read_snapshot<wchar_t>(snap.data(),snap.size()),
+    co::snapshot_error);
+
+  std::string bad_magic = snap;
+  bad_magic[0] = 'x';
+  BOOST_REQUIRE_THROW(co::read_snapshot(bad_magic.data(),bad_magic.size()),
+    co::snapshot_error);
+
+  // the tag of the first entry
+  std::string bad_tag = snap;
+  std::uint32_t tag = 9999;
+  std::memcpy(&bad_tag[sizeof(co::detail::snapshot_header)+12],&tag,
+    sizeof(tag));
+  BOOST_REQUIRE_THROW(co::read_snapshot(bad_tag.data(),bad_tag.size()),
+    co::snapshot_error);
+
+  BOOST_REQUIRE_THROW(co::load_snapshot("snapshot_test_missing.snap"),
+    co::snapshot_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
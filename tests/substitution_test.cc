@@ -295,6 +295,42 @@ BOOST_AUTO_TEST_CASE( default_EZ_substitution_test )
 }
 
 
+BOOST_AUTO_TEST_CASE( untaken_clause_substitution_test )
+{
+  string_type str = _LIT("%?V{%V}{%E}");
+  std::vector<detail::check_char_t> stack;
+
+  // the false clause would be recursive but is never rendered
+  auto &&result = co::detail::do_expand(str.begin(),str.begin(),str.end(),
+    _LIT_FN("KEY"),_LIT_FN("VALUE"),_LIT_FN("IMPLICIT"),_LIT_FN("%E"),stack);
+
+  BOOST_REQUIRE(result.first == str.end() && result.second == _LIT("VALUE"));
+}
+
+BOOST_AUTO_TEST_CASE( compiled_substitution_test )
+{
+  typedef co::detail::format_description<detail::check_char_t> format_type;
+
+  option_description_type desc;
+  desc.key_description = format_type(_LIT("--foo%?V{=<%V>%?I{[%I]}{}}{}"));
+  desc.value_description = _LIT_FN("arg");
+  desc.extended_description = format_type(_LIT("Extended description of %K"));
+
+  BOOST_REQUIRE(desc.key_description.target<format_type>()->program());
+
+  string_type out = _LIT(">");
+  co::detail::expand(out,desc.key_description,desc);
+  out.push_back('|');
+  co::detail::expand(out,desc.extended_description,desc);
+
+  BOOST_REQUIRE(out == _LIT(">--foo=<arg>|Extended description of --foo=<arg>"));
+
+  // a format that does not compile is reported when it is expanded
+  desc.key_description = format_type(_LIT("--foo}"));
+  BOOST_REQUIRE(!desc.key_description.target<format_type>()->program());
+  BOOST_REQUIRE_THROW(co::detail::expand(out,desc.key_description,desc),
+    co::formatter_error);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
 
@@ -16,7 +16,8 @@ bool operator==(const basic_option_pack<CharT> &lhs,
   return lhs.value_provided == rhs.value_provided
     && lhs.raw_key == rhs.raw_key
     && lhs.packed_arguments == rhs.packed_arguments
-    && lhs.value == rhs.value;
+    && lhs.value == rhs.value
+    && lhs.packed_flags == rhs.packed_flags;
 }
 
 }
@@ -150,7 +151,7 @@ inline bool is_empty(const co::basic_option_description<CharT> &desc)
     !desc.key_description && !desc.extended_description &&
     !desc.make_implicit_value &&
     !desc.implicit_value_description && !desc.make_value &&
-    !desc.finalize);
+    !desc.finalize && !desc.make_lazy_value);
 }
 
 /*
@@ -956,5 +956,33 @@ std::cerr << detail::to_string(vm,co::basic_value<string_type,detail::check_char
   ));
 }
 
+/**
+  The implicit value description is formatted once when the description
+  is made
+ */
+BOOST_AUTO_TEST_CASE( implicit_description_value_test )
+{
+  std::size_t count = 0;
+
+  co::basic_option_description<detail::check_char_t> desc =
+    co::make_option(_LIT("foo"),
+      co::basic_value<int,detail::check_char_t>()
+        .implicit(42)
+        .to_string([&](string_type &str, const int &val) {
+          ++count;
+          co::convert_value<int>::to_string(str,val);
+        }),
+      _LIT("case 6"));
+
+  BOOST_REQUIRE(count == 1);
+
+  BOOST_REQUIRE(desc.implicit_value_description() == _LIT("42"));
+  BOOST_REQUIRE(desc.value_description() == _LIT("arg"));
+  BOOST_REQUIRE(co::to_string(co::basic_options_group<detail::check_char_t>{
+    desc}).find(_LIT("<arg=42>")) != string_type::npos);
+
+  BOOST_REQUIRE(count == 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 